@@ -4,6 +4,8 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include "logging.hpp"
 #include "socket_utils.hpp"
 
@@ -14,31 +16,44 @@ void Init(const char *path) { TMP_PATH = path; }
 
 std::string GetTmpPath() { return TMP_PATH; }
 
-int Connect(uint8_t retry) {
+/**
+ * @brief Connects to the daemon, waiting up to `wait_ms` for it to listen.
+ *
+ * The monitor starts the daemon ahead of zygote, so it is normally listening already. If not,
+ * attempts back off from 1ms to at most 100ms apart, so the connection follows the daemon's
+ * readiness within a fraction of a second instead of whole-second sleeps.
+ */
+static int connect_socket(const std::string &socket_path, int wait_ms) {
     int fd = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
     struct sockaddr_un addr{
         .sun_family = AF_UNIX,
         .sun_path = {0},
     };
-    auto socket_path = TMP_PATH + kCPSocketName;
     strcpy(addr.sun_path, socket_path.c_str());
     socklen_t socklen = sizeof(addr);
 
-    while (retry--) {
+    int waited_ms = 0;
+    for (int delay_ms = 1;; delay_ms = std::min(delay_ms * 2, 100)) {
         int r = connect(fd, reinterpret_cast<struct sockaddr *>(&addr), socklen);
-        if (r == 0) return fd;
-        if (retry) {
-            LOGW("retrying to connect to zygiskd, sleep 1s");
-            sleep(1);
+        if (r == 0) {
+            if (waited_ms > 0) LOGI("connected to zygiskd after %dms", waited_ms);
+            return fd;
         }
+        if (waited_ms >= wait_ms) break;
+        if (waited_ms == 0) LOGW("zygiskd is not listening yet, waiting up to %dms", wait_ms);
+        delay_ms = std::min(delay_ms, wait_ms - waited_ms);
+        usleep(delay_ms * 1000);
+        waited_ms += delay_ms;
     }
 
     close(fd);
     return -1;
 }
 
+int Connect(int wait_ms) { return connect_socket(TMP_PATH + kCPSocketName, wait_ms); }
+
 bool PingHeartbeat() {
-    UniqueFd fd = Connect(5);
+    UniqueFd fd = Connect(4000);
     if (fd == -1) {
         PLOGE("connecting to zygiskd");
         return false;
@@ -47,19 +62,27 @@ bool PingHeartbeat() {
     return true;
 }
 
-uint32_t GetProcessFlags(uid_t uid) {
-    UniqueFd fd = Connect(1);
+uint32_t GetProcessFlags(uid_t uid) { return ReadProcessFlags(RequestProcessFlags(uid)); }
+
+int RequestProcessFlags(uid_t uid) {
+    int fd = Connect(0);
     if (fd == -1) {
         PLOGE("GetProcessFlags");
-        return 0;
+        return -1;
     }
     socket_utils::write_u8(fd, (uint8_t) SocketAction::GetProcessFlags);
     socket_utils::write_u32(fd, uid);
-    return socket_utils::read_u32(fd);
+    return fd;
+}
+
+uint32_t ReadProcessFlags(int fd) {
+    if (fd == -1) return 0;
+    UniqueFd conn = fd;
+    return socket_utils::read_u32(conn);
 }
 
 void CacheMountNamespace(pid_t pid) {
-    UniqueFd fd = Connect(1);
+    UniqueFd fd = Connect(0);
     if (fd == -1) {
         PLOGE("CacheMountNamespace");
     }
@@ -69,7 +92,7 @@ void CacheMountNamespace(pid_t pid) {
 
 // Returns the file descriptor >= 0 on success, or -1 on failure.
 int UpdateMountNamespace(MountNamespace type) {
-    UniqueFd fd = Connect(1);
+    UniqueFd fd = Connect(0);
     if (fd == -1) {
         PLOGE("UpdateMountNamespace");
         return -1;
@@ -96,7 +119,7 @@ int UpdateMountNamespace(MountNamespace type) {
 
 std::vector<Module> ReadModules() {
     std::vector<Module> modules;
-    UniqueFd fd = Connect(1);
+    UniqueFd fd = Connect(0);
     if (fd == -1) {
         PLOGE("ReadModules");
         return modules;
@@ -104,15 +127,20 @@ std::vector<Module> ReadModules() {
     socket_utils::write_u8(fd, (uint8_t) SocketAction::ReadModules);
     size_t len = socket_utils::read_usize(fd);
     for (size_t i = 0; i < len; i++) {
+        // Modules disabled by the crash governor are skipped, so indexes may have gaps.
+        size_t index = socket_utils::read_usize(fd);
         std::string name = socket_utils::read_string(fd);
+        bool preload = socket_utils::read_u8(fd) != 0;
+        bool has_config = socket_utils::read_u8(fd) != 0;
         int module_fd = socket_utils::recv_fd(fd);
-        modules.emplace_back(name, module_fd);
+        int config_fd = has_config ? socket_utils::recv_fd(fd) : -1;
+        modules.emplace_back(index, name, module_fd, preload, config_fd);
     }
     return modules;
 }
 
 int ConnectCompanion(size_t index) {
-    int fd = Connect(1);
+    int fd = Connect(0);
     if (fd == -1) {
         PLOGE("ConnectCompanion");
         return -1;
@@ -128,7 +156,7 @@ int ConnectCompanion(size_t index) {
 }
 
 int GetModuleDir(size_t index) {
-    UniqueFd fd = Connect(1);
+    UniqueFd fd = Connect(0);
     if (fd == -1) {
         PLOGE("GetModuleDir");
         return -1;
@@ -138,8 +166,9 @@ int GetModuleDir(size_t index) {
     return socket_utils::recv_fd(fd);
 }
 
-void ZygoteRestart() {
-    UniqueFd fd = Connect(1);
+void ZygoteRestart(std::string_view abi, uint32_t disabled_modules) {
+    // The tracer of a 64-bit device also injects the 32-bit zygote, whose daemon is not ours.
+    UniqueFd fd = connect_socket(TMP_PATH + "/cp" + std::string(abi) + ".sock", 0);
     if (fd == -1) {
         if (errno == ENOENT) {
             LOGD("could not notify ZygoteRestart (maybe it hasn't been created)");
@@ -148,13 +177,14 @@ void ZygoteRestart() {
         }
         return;
     }
-    if (!socket_utils::write_u8(fd, (uint8_t) SocketAction::ZygoteRestart)) {
+    if (!socket_utils::write_u8(fd, (uint8_t) SocketAction::ZygoteRestart) ||
+        !socket_utils::write_u32(fd, disabled_modules)) {
         PLOGE("request ZygoteRestart");
     }
 }
 
 void SystemServerStarted() {
-    UniqueFd fd = Connect(1);
+    UniqueFd fd = Connect(0);
     if (fd == -1) {
         PLOGE("report system server started");
     } else {
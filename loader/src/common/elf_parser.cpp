@@ -289,4 +289,204 @@ bool ElfImage::findLoadedLibraryInfo(std::string_view library_name) {
     return info.found;
 }
 
+// --- DynamicImage ---
+
+#ifndef DT_ANDROID_REL
+#define DT_ANDROID_REL (DT_LOOS + 2)
+#define DT_ANDROID_RELSZ (DT_LOOS + 3)
+#define DT_ANDROID_RELA (DT_LOOS + 4)
+#define DT_ANDROID_RELASZ (DT_LOOS + 5)
+#endif
+
+#if defined(__LP64__)
+#define ELFW_R_SYM(info) ELF64_R_SYM(info)
+#define ELFW_R_TYPE(info) ELF64_R_TYPE(info)
+#else
+#define ELFW_R_SYM(info) ELF32_R_SYM(info)
+#define ELFW_R_TYPE(info) ELF32_R_TYPE(info)
+#endif
+
+// Relocation types of GOT slots that hold the bare address of a symbol. Absolute relocations are
+// left out: they also fill data such as function pointer tables, and may carry an addend.
+static bool is_symbol_slot(uint32_t type) {
+#if defined(__aarch64__)
+    return type == R_AARCH64_JUMP_SLOT || type == R_AARCH64_GLOB_DAT;
+#elif defined(__x86_64__)
+    return type == R_X86_64_JUMP_SLOT || type == R_X86_64_GLOB_DAT;
+#elif defined(__arm__)
+    return type == R_ARM_JUMP_SLOT || type == R_ARM_GLOB_DAT;
+#elif defined(__i386__)
+    return type == R_386_JMP_SLOT || type == R_386_GLOB_DAT;
+#else
+    return false;
+#endif
+}
+
+bool DynamicImage::parse(uintptr_t header) {
+    auto* ehdr = reinterpret_cast<const ElfW(Ehdr)*>(header);
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0) return false;
+
+    auto* phdrs = reinterpret_cast<const ElfW(Phdr)*>(header + ehdr->e_phoff);
+    const ElfW(Dyn)* dynamic = nullptr;
+    bool bias_found = false;
+    for (int i = 0; i < ehdr->e_phnum; ++i) {
+        if (phdrs[i].p_type == PT_LOAD && !bias_found) {
+            // The ELF header is mapped at the start of the first PT_LOAD segment.
+            bias_ = header - (phdrs[i].p_vaddr - phdrs[i].p_offset);
+            bias_found = true;
+        } else if (phdrs[i].p_type == PT_DYNAMIC) {
+            dynamic = reinterpret_cast<const ElfW(Dyn)*>(phdrs[i].p_vaddr);
+        }
+    }
+    if (!bias_found || dynamic == nullptr) return false;
+    dynamic = reinterpret_cast<const ElfW(Dyn)*>(bias_ + reinterpret_cast<uintptr_t>(dynamic));
+
+    // Bionic leaves the dynamic section untouched, but other loaders relocate its addresses in
+    // place. A virtual address is always below the load bias of a relocated image.
+    auto address = [this](uintptr_t value) { return value >= bias_ ? value : bias_ + value; };
+    for (auto* dyn = dynamic; dyn->d_tag != DT_NULL; ++dyn) {
+        uintptr_t value = dyn->d_un.d_ptr;
+        switch (dyn->d_tag) {
+        case DT_SYMTAB:
+            symtab_ = reinterpret_cast<const ElfW(Sym)*>(address(value));
+            break;
+        case DT_STRTAB:
+            strtab_ = reinterpret_cast<const char*>(address(value));
+            break;
+        case DT_JMPREL:
+            jmprel_ = address(value);
+            break;
+        case DT_PLTRELSZ:
+            jmprel_size_ = value;
+            break;
+        case DT_PLTREL:
+            jmprel_rela_ = value == DT_RELA;
+            break;
+        case DT_REL:
+            rel_ = address(value);
+            break;
+        case DT_RELSZ:
+            rel_size_ = value;
+            break;
+        case DT_RELA:
+            rela_ = address(value);
+            break;
+        case DT_RELASZ:
+            rela_size_ = value;
+            break;
+        case DT_ANDROID_REL:
+        case DT_ANDROID_RELA:
+            packed_ = address(value);
+            packed_rela_ = dyn->d_tag == DT_ANDROID_RELA;
+            break;
+        case DT_ANDROID_RELSZ:
+        case DT_ANDROID_RELASZ:
+            packed_size_ = value;
+            break;
+        default:
+            break;
+        }
+    }
+    return symtab_ != nullptr && strtab_ != nullptr;
+}
+
+void DynamicImage::forEachSymbolSlot(
+    const std::function<void(std::string_view, uintptr_t)>& fn) const {
+    forEachRelocation(jmprel_, jmprel_size_, jmprel_rela_, fn);
+    forEachRelocation(rel_, rel_size_, false, fn);
+    forEachRelocation(rela_, rela_size_, true, fn);
+    forEachPackedRelocation(packed_, packed_size_, packed_rela_, fn);
+}
+
+void DynamicImage::visit(ElfW(Addr) offset, ElfW(Xword) info, ElfW(Addr) addend,
+                         const std::function<void(std::string_view, uintptr_t)>& fn) const {
+    auto sym = ELFW_R_SYM(info);
+    // A slot holding `symbol + addend` cannot be replaced by the bare address of a hook.
+    if (sym == 0 || addend != 0 || !is_symbol_slot(ELFW_R_TYPE(info))) return;
+    fn(strtab_ + symtab_[sym].st_name, bias_ + offset);
+}
+
+void DynamicImage::forEachRelocation(
+    uintptr_t table, size_t size, bool rela,
+    const std::function<void(std::string_view, uintptr_t)>& fn) const {
+    if (table == 0) return;
+    if (rela) {
+        auto* rel = reinterpret_cast<const ElfW(Rela)*>(table);
+        for (size_t i = 0; i < size / sizeof(ElfW(Rela)); ++i) {
+            visit(rel[i].r_offset, rel[i].r_info, rel[i].r_addend, fn);
+        }
+    } else {
+        // REL slots of these types ignore the implicit addend.
+        auto* rel = reinterpret_cast<const ElfW(Rel)*>(table);
+        for (size_t i = 0; i < size / sizeof(ElfW(Rel)); ++i) {
+            visit(rel[i].r_offset, rel[i].r_info, 0, fn);
+        }
+    }
+}
+
+/**
+ * @brief Decodes an Android packed ("APS2") relocation table.
+ *
+ * The table is a stream of SLEB128 numbers describing groups of relocations that share their
+ * offset delta, info or addend, as produced by `relocation_packer` and lld's `--pack-dyn-relocs`.
+ */
+void DynamicImage::forEachPackedRelocation(
+    uintptr_t table, size_t size, bool rela,
+    const std::function<void(std::string_view, uintptr_t)>& fn) const {
+    constexpr size_t GROUPED_BY_INFO = 1, GROUPED_BY_OFFSET_DELTA = 2, GROUPED_BY_ADDEND = 4,
+                     GROUP_HAS_ADDEND = 8;
+
+    if (table == 0 || size < 4 || memcmp(reinterpret_cast<const void*>(table), "APS2", 4) != 0) {
+        return;
+    }
+    auto* p = reinterpret_cast<const uint8_t*>(table) + 4;
+    auto* end = reinterpret_cast<const uint8_t*>(table) + size;
+    bool truncated = false;
+    auto next = [&]() -> ElfW(Addr) {
+        ElfW(Addr) value = 0;
+        size_t shift = 0;
+        uint8_t byte;
+        do {
+            if (p == end) {
+                truncated = true;
+                return 0;
+            }
+            byte = *p++;
+            value |= static_cast<ElfW(Addr)>(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        if (shift < sizeof(ElfW(Addr)) * 8 && (byte & 0x40)) {
+            value |= ~static_cast<ElfW(Addr)>(0) << shift;
+        }
+        return value;
+    };
+
+    ElfW(Addr) remaining = next();
+    ElfW(Addr) offset = next();
+    ElfW(Addr) info = 0;
+    // Addends are deltas against the previous one, and reset by groups that have none.
+    ElfW(Addr) addend = 0;
+    while (remaining > 0 && !truncated) {
+        ElfW(Addr) group_size = next();
+        ElfW(Addr) flags = next();
+        ElfW(Addr) offset_delta = (flags & GROUPED_BY_OFFSET_DELTA) ? next() : 0;
+        if (flags & GROUPED_BY_INFO) info = next();
+        if (rela && (flags & GROUP_HAS_ADDEND) && (flags & GROUPED_BY_ADDEND)) {
+            addend += next();
+        } else if (!(flags & GROUP_HAS_ADDEND)) {
+            addend = 0;
+        }
+        if (group_size > remaining) return;
+        for (ElfW(Addr) i = 0; i < group_size && !truncated; ++i) {
+            offset += (flags & GROUPED_BY_OFFSET_DELTA) ? offset_delta : next();
+            if (!(flags & GROUPED_BY_INFO)) info = next();
+            if (rela && (flags & GROUP_HAS_ADDEND) && !(flags & GROUPED_BY_ADDEND)) {
+                addend += next();
+            }
+            if (!truncated) visit(offset, info, addend, fn);
+        }
+        remaining -= group_size;
+    }
+}
+
 }  // namespace ElfParser
@@ -0,0 +1,54 @@
+#include "kernel_caps.hpp"
+
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "logging.hpp"
+
+// Syscalls added after the NDK headers we build against; their numbers are shared by all ABIs.
+#ifndef __NR_fsopen
+#define __NR_fsopen 430
+#endif
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
+#ifndef __NR_close_range
+#define __NR_close_range 436
+#endif
+
+namespace kernel_caps {
+
+static bool has_syscall(long ret) { return ret != -1 || errno != ENOSYS; }
+
+static bool status_reports_seccomp_filters() {
+    auto file = std::unique_ptr<FILE, decltype(&fclose)>{fopen("/proc/self/status", "re"), &fclose};
+    if (!file) return false;
+    char line[256];
+    while (fgets(line, sizeof(line), file.get()) != nullptr) {
+        if (strncmp(line, "Seccomp_filters:", strlen("Seccomp_filters:")) == 0) return true;
+    }
+    return false;
+}
+
+uint32_t Probe() {
+    uint32_t caps = PROBED;
+    if (status_reports_seccomp_filters()) caps |= SECCOMP_FILTER_COUNT;
+    // An empty range starting past any valid descriptor closes nothing.
+    if (has_syscall(syscall(__NR_close_range, ~0u, ~0u, 0))) caps |= CLOSE_RANGE;
+    // Negative PIDs are rejected with EINVAL.
+    if (has_syscall(syscall(__NR_pidfd_open, -1, 0))) caps |= PIDFD;
+    // Reading nothing from ourselves succeeds.
+    if (process_vm_readv(getpid(), nullptr, 0, nullptr, 0, 0) == 0) caps |= PROCESS_VM_READV;
+    // A null filesystem name faults with EFAULT.
+    if (has_syscall(syscall(__NR_fsopen, nullptr, 0))) caps |= NEW_MOUNT_API;
+    LOGV("kernel capabilities: 0x%x", caps);
+    return caps;
+}
+
+}  // namespace kernel_caps
@@ -0,0 +1,177 @@
+#include "log_ring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+
+#include "logging.hpp"
+
+namespace LogRing {
+
+namespace {
+
+constexpr uint64_t CAPACITY = 128;
+// Past this many pending records, the thread that logs flushes the buffer itself.
+constexpr uint64_t FLUSH_THRESHOLD = CAPACITY * 3 / 4;
+
+Entry ring[CAPACITY];
+std::atomic<uint64_t> head{0};  // Next ticket to hand out.
+std::atomic<uint64_t> tail{0};  // Next ticket to flush.
+std::atomic<uint64_t> dropped{0};
+std::atomic_flag flushing = ATOMIC_FLAG_INIT;
+
+/**
+ * @brief Formats a single conversion specification with its recorded argument.
+ *
+ * The length modifier of the specification is replaced so that the argument, which was widened
+ * when it was recorded, is passed back with the width the format asks for.
+ */
+int format_arg(char *out, size_t size, const char *spec, size_t spec_len, const Entry &entry,
+               const Arg &arg) {
+    char conversion = spec[spec_len - 1];
+    // Split "%<flags><width><precision><length><conversion>" around the length modifier.
+    size_t length_start = 1;
+    while (length_start < spec_len - 1 && strchr("-+ #0123456789.", spec[length_start])) {
+        ++length_start;
+    }
+    char length[3] = {};
+    memcpy(length, spec + length_start, std::min<size_t>(spec_len - 1 - length_start, 2));
+
+    char fmt[32];
+    int prefix = static_cast<int>(std::min<size_t>(length_start, sizeof(fmt) - 4));
+    switch (conversion) {
+    case 'd':
+    case 'i': {
+        auto value = static_cast<int64_t>(arg.word);
+        if (!strcmp(length, "hh")) value = static_cast<signed char>(value);
+        else if (!strcmp(length, "h")) value = static_cast<short>(value);
+        else if (length[0] == '\0') value = static_cast<int>(value);
+        else if (!strcmp(length, "l") || !strcmp(length, "z") || !strcmp(length, "t"))
+            value = static_cast<long>(value);
+        snprintf(fmt, sizeof(fmt), "%.*sll%c", prefix, spec, conversion);
+        return snprintf(out, size, fmt, static_cast<long long>(value));
+    }
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X': {
+        uint64_t value = arg.word;
+        if (!strcmp(length, "hh")) value = static_cast<unsigned char>(value);
+        else if (!strcmp(length, "h")) value = static_cast<unsigned short>(value);
+        else if (length[0] == '\0') value = static_cast<unsigned int>(value);
+        else if (!strcmp(length, "l") || !strcmp(length, "z") || !strcmp(length, "t"))
+            value = static_cast<unsigned long>(value);
+        snprintf(fmt, sizeof(fmt), "%.*sll%c", prefix, spec, conversion);
+        return snprintf(out, size, fmt, static_cast<unsigned long long>(value));
+    }
+    case 'c':
+        snprintf(fmt, sizeof(fmt), "%.*sc", prefix, spec);
+        return snprintf(out, size, fmt, static_cast<int>(arg.word));
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        snprintf(fmt, sizeof(fmt), "%.*s%c", prefix, spec, conversion);
+        return snprintf(out, size, fmt,
+                        arg.type == ArgType::DOUBLE ? std::bit_cast<double>(arg.word) : 0.0);
+    case 'p':
+        snprintf(fmt, sizeof(fmt), "%.*sp", prefix, spec);
+        return snprintf(out, size, fmt, reinterpret_cast<void *>(arg.word));
+    case 's': {
+        const char *str = "";
+        if (arg.type == ArgType::STR && arg.word < Entry::STRING_SPACE) {
+            str = entry.strings + arg.word;
+        }
+        snprintf(fmt, sizeof(fmt), "%.*ss", prefix, spec);
+        return snprintf(out, size, fmt, str);
+    }
+    default:
+        return snprintf(out, size, "%.*s", static_cast<int>(spec_len), spec);
+    }
+}
+
+void write_entry(const Entry &entry) {
+    char buf[1024];
+    size_t pos = 0;
+    uint8_t next_arg = 0;
+    auto advance = [&](int n) {
+        if (n > 0) pos = std::min(pos + static_cast<size_t>(n), sizeof(buf) - 1);
+    };
+    for (const char *p = entry.fmt; *p != '\0' && pos < sizeof(buf) - 1;) {
+        if (*p != '%') {
+            buf[pos++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            buf[pos++] = '%';
+            p += 2;
+            continue;
+        }
+        size_t len = 1;
+        while (p[len] != '\0' && !strchr("diuoxXcsfFeEgGaAp", p[len])) ++len;
+        if (p[len] == '\0' || next_arg == entry.argc) {
+            // Malformed, or the record ran out of argument slots: emit the rest verbatim.
+            advance(snprintf(buf + pos, sizeof(buf) - pos, "%s", p));
+            break;
+        }
+        ++len;
+        advance(format_arg(buf + pos, sizeof(buf) - pos, p, len, entry, entry.args[next_arg++]));
+        p += len;
+    }
+    buf[pos] = '\0';
+    __android_log_write(entry.priority, entry.tag, buf);
+}
+
+}  // namespace
+
+Entry *Reserve(uint64_t &ticket) {
+    uint64_t t = head.load(std::memory_order_relaxed);
+    do {
+        if (t - tail.load(std::memory_order_acquire) >= CAPACITY) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+    } while (!head.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel));
+    ticket = t;
+    return &ring[t % CAPACITY];
+}
+
+void Commit(Entry *entry, uint64_t ticket) {
+    entry->ready.store(ticket + 1, std::memory_order_release);
+    if (ticket + 1 - tail.load(std::memory_order_relaxed) >= FLUSH_THRESHOLD) Flush();
+}
+
+bool Pending() {
+    return head.load(std::memory_order_relaxed) != tail.load(std::memory_order_relaxed) ||
+           dropped.load(std::memory_order_relaxed) != 0;
+}
+
+void Flush() {
+    // A single thread flushes at a time; the others leave their records for it.
+    if (flushing.test_and_set(std::memory_order_acquire)) return;
+    // LOGI and friends flush before their arguments are evaluated, and those may read errno.
+    int saved_errno = errno;
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    uint64_t end = head.load(std::memory_order_acquire);
+    for (; t != end; ++t) {
+        Entry &entry = ring[t % CAPACITY];
+        // Stop at a record that is still being written; it goes out with the next flush.
+        if (entry.ready.load(std::memory_order_acquire) != t + 1) break;
+        write_entry(entry);
+        tail.store(t + 1, std::memory_order_release);
+    }
+    if (uint64_t lost = dropped.exchange(0, std::memory_order_relaxed); lost != 0) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "log buffer full, %llu messages dropped",
+                 static_cast<unsigned long long>(lost));
+        __android_log_write(ANDROID_LOG_WARN, LOG_TAG, buf);
+    }
+    flushing.clear(std::memory_order_release);
+    errno = saved_errno;
+}
+
+}  // namespace LogRing
@@ -0,0 +1,96 @@
+#include "trace_marker.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+#include "logging.hpp"
+
+namespace trace_marker {
+
+namespace {
+
+int marker_fd = -1;
+// Records start with the pid of the writer, formatted once per process rather than per record.
+pid_t record_pid = 0;
+char begin_prefix[24];  // "B|<pid>|"
+size_t begin_len = 0;
+char end_record[24];  // "E|<pid>"
+size_t end_len = 0;
+
+void refresh_prefixes() {
+    pid_t pid = getpid();
+    if (pid == record_pid) return;
+    record_pid = pid;
+    begin_len = snprintf(begin_prefix, sizeof(begin_prefix), "B|%d|", pid);
+    end_len = snprintf(end_record, sizeof(end_record), "E|%d", pid);
+}
+
+void append(char *buf, size_t &len, size_t size, std::string_view text) {
+    size_t n = std::min(text.size(), size - len);
+    memcpy(buf + len, text.data(), n);
+    len += n;
+}
+
+}  // namespace
+
+bool Open() {
+    if (marker_fd >= 0) return true;
+    for (const char *path :
+         {"/sys/kernel/tracing/trace_marker", "/sys/kernel/debug/tracing/trace_marker"}) {
+        marker_fd = open(path, O_WRONLY | O_CLOEXEC);
+        if (marker_fd >= 0) {
+            LOGV("writing trace markers to %s", path);
+            return true;
+        }
+    }
+    PLOGE("open trace_marker");
+    return false;
+}
+
+void Close() {
+    if (marker_fd < 0) return;
+    close(marker_fd);
+    marker_fd = -1;
+}
+
+bool Enabled() { return marker_fd >= 0; }
+
+void Begin(std::string_view name, std::string_view detail) {
+    if (marker_fd < 0) return;
+    // Markers are placed around hooked libc calls, which must not see errno change.
+    int saved_errno = errno;
+    refresh_prefixes();
+    char buf[256];
+    size_t len = 0;
+    append(buf, len, sizeof(buf), {begin_prefix, begin_len});
+    append(buf, len, sizeof(buf), name);
+    if (!detail.empty()) {
+        append(buf, len, sizeof(buf), " ");
+        append(buf, len, sizeof(buf), detail);
+    }
+    write(marker_fd, buf, len);
+    errno = saved_errno;
+}
+
+void End() {
+    if (marker_fd < 0) return;
+    int saved_errno = errno;
+    refresh_prefixes();
+    write(marker_fd, end_record, end_len);
+    errno = saved_errno;
+}
+
+Scope::Scope(std::string_view name, long id) {
+    if (marker_fd < 0) return;
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), id);
+    Begin(name, {buf, static_cast<size_t>(result.ptr - buf)});
+}
+
+}  // namespace trace_marker
@@ -24,7 +24,7 @@
 #include <jni.h>
 #include <sys/types.h>
 
-#define ZYGISK_API_VERSION 5
+#define ZYGISK_API_VERSION 6
 
 /*
 
@@ -49,6 +49,10 @@ This enable developers to inject code and alter the behavior of system_server an
 Please note that modules will only be loaded after zygote has forked the child process.
 THIS MEANS ALL OF YOUR CODE RUNS IN THE APP/SYSTEM_SERVER PROCESS, NOT THE ZYGOTE DAEMON!
 
+The only exception are modules that ship an empty `zygisk/preload` file in their module
+directory. Such modules are loaded into zygote itself before its first fork, and their
+ModuleBase::onZygoteLoad() runs there once; see that method for details.
+
 *********************
 * Development Guide
 *********************
@@ -112,6 +116,17 @@ public:
     // A Zygisk API handle will be passed as an argument.
     virtual void onLoad([[maybe_unused]] Api *api, [[maybe_unused]] JNIEnv *env) {}
 
+    // This method is called once in zygote, only for modules loaded into zygote (see the
+    // introduction), before onLoad is called in any process. Everything it builds is inherited
+    // copy-on-write by every process zygote forks, so it is the place to parse configs, resolve
+    // symbols and precompute tables that would otherwise be rebuilt in every app.
+    //
+    // Only Api::getModuleDir() and Api::getConfig() work here; close the file descriptor returned
+    // by the former before returning.
+    // The code runs with zygote's privilege, and must neither leave file descriptors open nor
+    // start threads, or zygote will abort on its next fork.
+    virtual void onZygoteLoad([[maybe_unused]] Api *api, [[maybe_unused]] JNIEnv *env) {}
+
     // This method is called before the app process is specialized.
     // At this point, the process just got forked from zygote, but no app specific specialization
     // is applied. This means that the process does not have any sandbox restrictions and
@@ -239,6 +254,17 @@ struct Api {
     // Returns -1 if errors occurred.
     int getModuleDir();
 
+    // Get a read-only view of the module's config blob: the content of the `zygisk/config` file
+    // in the root folder of the current module, as read by the daemon when the module was loaded
+    // and again whenever the file changes.
+    //
+    // Unlike reading the file through getModuleDir(), this costs neither IPC nor file access:
+    // the blob is mapped before onLoad. The view is only valid until post[XXX]Specialize (or
+    // onZygoteLoad) returns; copy whatever has to outlive it.
+    //
+    // Returns nullptr and sets *size to 0 if the module has no config. `size` may be null.
+    const void *getConfig(size_t *size);
+
     // Set various options for your module.
     // Please note that this method accepts one single option at a time.
     // Check zygisk::Option for the full list of options available.
@@ -324,11 +350,16 @@ struct module_abi {
     void (*preServerSpecialize)(ModuleBase *, ServerSpecializeArgs *);
     void (*postServerSpecialize)(ModuleBase *, const ServerSpecializeArgs *);
 
-    module_abi(ModuleBase *module) : api_version(ZYGISK_API_VERSION), impl(module) {
+    void (*onZygoteLoad)(ModuleBase *, Api *, JNIEnv *);
+    Api *api;
+
+    module_abi(ModuleBase *module, Api *module_api)
+        : api_version(ZYGISK_API_VERSION), impl(module), api(module_api) {
         preAppSpecialize = [](auto m, auto args) { m->preAppSpecialize(args); };
         postAppSpecialize = [](auto m, auto args) { m->postAppSpecialize(args); };
         preServerSpecialize = [](auto m, auto args) { m->preServerSpecialize(args); };
         postServerSpecialize = [](auto m, auto args) { m->postServerSpecialize(args); };
+        onZygoteLoad = [](auto m, auto a, auto env) { m->onZygoteLoad(a, env); };
     }
 };
 
@@ -345,6 +376,7 @@ struct api_table {
     void (*setOption)(void * /* impl */, Option);
     int (*getModuleDir)(void * /* impl */);
     uint32_t (*getFlags)(void * /* impl */);
+    const void *(*getConfig)(void * /* impl */, size_t *);
 };
 
 template <class T>
@@ -353,7 +385,8 @@ void entry_impl(api_table *table, JNIEnv *env) {
     api.tbl = table;
     static T module;
     ModuleBase *m = &module;
-    static module_abi abi(m);
+    static module_abi abi(m, &api);
+    // Registration fails in zygote, where only onZygoteLoad is called.
     if (!table->registerModule(table, &abi)) return;
     m->onLoad(&api, env);
 }
@@ -368,6 +401,11 @@ inline void Api::setOption(Option opt) {
     if (tbl->setOption) tbl->setOption(tbl->impl, opt);
 }
 inline uint32_t Api::getFlags() { return tbl->getFlags ? tbl->getFlags(tbl->impl) : 0; }
+inline const void *Api::getConfig(size_t *size) {
+    if (tbl->getConfig) return tbl->getConfig(tbl->impl, size);
+    if (size) *size = 0;
+    return nullptr;
+}
 inline bool Api::exemptFd(int fd) { return tbl->exemptFd != nullptr && tbl->exemptFd(fd); }
 inline void Api::hookJniNativeMethods(JNIEnv *env, const char *className, JNINativeMethod *methods,
                                       int numMethods) {
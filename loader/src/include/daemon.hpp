@@ -49,10 +49,17 @@ private:
 namespace zygiskd {
 
 struct Module {
+    // Position in the daemon's module list, used to address the module in later requests.
+    size_t index;
     std::string name;
     UniqueFd memfd;
+    // The module ships `zygisk/preload` and is loaded into zygote before its first fork.
+    bool preload;
+    // Sealed copy of the module's `zygisk/config`; -1 if it has none.
+    UniqueFd config_fd;
 
-    inline explicit Module(std::string name, int memfd) : name(name), memfd(memfd) {}
+    inline explicit Module(size_t index, std::string name, int memfd, bool preload, int config_fd)
+        : index(index), name(name), memfd(memfd), preload(preload), config_fd(config_fd) {}
 };
 
 enum class SocketAction {
@@ -79,6 +86,13 @@ std::vector<Module> ReadModules();
 
 uint32_t GetProcessFlags(uid_t uid);
 
+// Sends a GetProcessFlags query without waiting for the reply; returns the connection to read it
+// from with ReadProcessFlags(), or -1 on failure.
+int RequestProcessFlags(uid_t uid);
+
+// Reads the reply to RequestProcessFlags() and closes the connection; 0 if `fd` is -1.
+uint32_t ReadProcessFlags(int fd);
+
 void CacheMountNamespace(pid_t pid);
 
 int UpdateMountNamespace(MountNamespace type);
@@ -87,7 +101,9 @@ int ConnectCompanion(size_t index);
 
 int GetModuleDir(size_t index);
 
-void ZygoteRestart();
+/// Tells the daemon of `abi` ("32" or "64") that its zygote restarts, and which modules it must
+/// not load into it.
+void ZygoteRestart(std::string_view abi, uint32_t disabled_modules);
 
 void SystemServerStarted();
 }  // namespace zygiskd
@@ -3,6 +3,7 @@
 #include <link.h>
 
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -200,6 +201,48 @@ constexpr uint32_t ElfImage::calculateGnuHash(std::string_view name) {
     return h;
 }
 
+/**
+ * @class DynamicImage
+ * @brief Reads the dynamic section of an ELF image as it is mapped in this process.
+ *
+ * Unlike ElfImage, nothing is read from disk: the program headers are found through the mapped
+ * ELF header and every table is used in place. This is enough to find the GOT slots through which
+ * an image imports a symbol.
+ */
+class DynamicImage {
+public:
+    /**
+     * @brief Parses the image whose ELF header is mapped at `header`.
+     * @return False if the header is not a valid ELF header or the image has no dynamic section.
+     */
+    bool parse(uintptr_t header);
+
+    /**
+     * @brief Calls `fn(symbol_name, slot_address)` for every relocation that stores the bare
+     *        address of a named symbol: PLT jump slots and GOT entries without an addend,
+     *        including those in Android packed relocation tables.
+     */
+    void forEachSymbolSlot(const std::function<void(std::string_view, uintptr_t)>& fn) const;
+
+private:
+    void forEachRelocation(uintptr_t table, size_t size, bool rela,
+                           const std::function<void(std::string_view, uintptr_t)>& fn) const;
+    void forEachPackedRelocation(uintptr_t table, size_t size, bool rela,
+                                 const std::function<void(std::string_view, uintptr_t)>& fn) const;
+    void visit(ElfW(Addr) offset, ElfW(Xword) info, ElfW(Addr) addend,
+               const std::function<void(std::string_view, uintptr_t)>& fn) const;
+
+    uintptr_t bias_ = 0;
+    const ElfW(Sym)* symtab_ = nullptr;
+    const char* strtab_ = nullptr;
+    uintptr_t jmprel_ = 0, jmprel_size_ = 0;
+    bool jmprel_rela_ = false;
+    uintptr_t rel_ = 0, rel_size_ = 0;
+    uintptr_t rela_ = 0, rela_size_ = 0;
+    uintptr_t packed_ = 0, packed_size_ = 0;
+    bool packed_rela_ = false;
+};
+
 // --- Helper Functions for Symbol Lookups ---
 
 /**
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Kernel features that NeoZygisk adapts its behaviour to.
+ *
+ * The monitor probes them once at startup and hands the resulting bitmap to every tracer it
+ * starts, which passes it on to the injected library's `entry()`. Injected processes can then
+ * make their decisions without probing the kernel or parsing procfs themselves.
+ */
+namespace kernel_caps {
+
+enum : uint32_t {
+    // /proc/<pid>/status reports "Seccomp_filters:" (Linux 5.9+), so filters are visible.
+    SECCOMP_FILTER_COUNT = 1u << 0,
+    CLOSE_RANGE = 1u << 1,
+    PIDFD = 1u << 2,
+    PROCESS_VM_READV = 1u << 3,
+    // fsopen()/fsmount()/move_mount() and friends.
+    NEW_MOUNT_API = 1u << 4,
+    // Not a kernel feature: set by the monitor to enable trace markers, see trace_marker.hpp.
+    TRACE_MARKER = 1u << 30,
+    // Set in every probed bitmap, so that "nothing supported" differs from "never probed".
+    PROBED = 1u << 31,
+};
+
+/**
+ * @brief Probes the running kernel.
+ *
+ * Every syscall is issued with arguments it rejects without side effects, so the probe only tells
+ * apart `ENOSYS` from any other outcome.
+ */
+uint32_t Probe();
+
+}  // namespace kernel_caps
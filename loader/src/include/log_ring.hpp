@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * @brief A lock-free, per-process buffer for verbose log messages.
+ *
+ * Formatting a message and handing it to logd costs far more than the code most `LOGV` calls
+ * instrument. Instead, `Log()` only records the format string, which lives in read-only data, and
+ * the raw arguments; string arguments are copied, since they may not outlive the call. Records
+ * are formatted and written out in batches by `Flush()`, which runs when the buffer fills up,
+ * before any message of a higher priority (so the output stays ordered), and at the points where
+ * pending records would otherwise be lost: before forking, before the injector unmaps itself and
+ * between event loop iterations of the tracer.
+ *
+ * When the buffer is full, new records are dropped and the number of lost records is reported
+ * by the next flush.
+ */
+namespace LogRing {
+
+enum class ArgType : uint8_t { INT, UINT, DOUBLE, PTR, STR };
+
+struct Arg {
+    ArgType type;
+    uint64_t word;  // For STR, the offset of the copied string in `Entry::strings`.
+};
+
+struct Entry {
+    static constexpr size_t MAX_ARGS = 8;
+    static constexpr size_t STRING_SPACE = 192;
+
+    std::atomic<uint64_t> ready;  // Ticket + 1 once the record is complete.
+    int priority;
+    const char *tag;
+    const char *fmt;
+    uint8_t argc;
+    Arg args[MAX_ARGS];
+    uint16_t strings_used;
+    char strings[STRING_SPACE];
+};
+
+/// Returns a free entry, or nullptr if the buffer is full.
+Entry *Reserve(uint64_t &ticket);
+/// Publishes a reserved entry.
+void Commit(Entry *entry, uint64_t ticket);
+/// Formats and writes out every complete record.
+void Flush();
+/// True if records are waiting to be flushed.
+bool Pending();
+
+template <typename T>
+inline void capture(Entry &entry, T value) {
+    if constexpr (std::is_enum_v<T>) {
+        return capture(entry, static_cast<std::underlying_type_t<T>>(value));
+    }
+    if (entry.argc == Entry::MAX_ARGS) return;
+    Arg &arg = entry.args[entry.argc++];
+    if constexpr (std::is_same_v<T, const char *> || std::is_same_v<T, char *>) {
+        const char *str = value ? value : "(null)";
+        size_t room = Entry::STRING_SPACE - entry.strings_used;
+        size_t len = room > 0 ? strnlen(str, room - 1) : 0;
+        arg.type = ArgType::STR;
+        arg.word = entry.strings_used;
+        if (room > 0) {
+            memcpy(entry.strings + entry.strings_used, str, len);
+            entry.strings[entry.strings_used + len] = '\0';
+            entry.strings_used += len + 1;
+        } else {
+            arg.word = Entry::STRING_SPACE;  // No room left; flushed as an empty string.
+        }
+    } else if constexpr (std::is_floating_point_v<T>) {
+        arg.type = ArgType::DOUBLE;
+        arg.word = std::bit_cast<uint64_t>(static_cast<double>(value));
+    } else if constexpr (std::is_pointer_v<T> || std::is_null_pointer_v<T>) {
+        arg.type = ArgType::PTR;
+        arg.word = reinterpret_cast<uintptr_t>(value);
+    } else if constexpr (std::is_signed_v<T>) {
+        arg.type = ArgType::INT;
+        arg.word = static_cast<uint64_t>(static_cast<int64_t>(value));
+    } else {
+        arg.type = ArgType::UINT;
+        arg.word = static_cast<uint64_t>(value);
+    }
+}
+
+/// Records a message. Arguments are taken by value, so arrays decay to pointers as in printf.
+template <typename... Args>
+inline void Log(int priority, const char *tag, const char *fmt, Args... args) {
+    uint64_t ticket;
+    Entry *entry = Reserve(ticket);
+    if (entry == nullptr) return;
+    entry->priority = priority;
+    entry->tag = tag;
+    entry->fmt = fmt;
+    entry->argc = 0;
+    entry->strings_used = 0;
+    (capture(*entry, args), ...);
+    Commit(entry, ticket);
+}
+
+}  // namespace LogRing
@@ -12,3 +12,25 @@
 #endif
 
 #include "../external/lsplt/lsplt/src/main/jni/logging.hpp"
+
+#include "log_ring.hpp"
+
+// Verbose and debug messages are recorded into LogRing and written out in batches, away from the
+// code paths they instrument. Release builds only keep them when configured with ZKSU_VERBOSE_LOG.
+// Everything else is logged synchronously, after the pending records so the output stays in order.
+#if !defined(NDEBUG) || defined(ZKSU_VERBOSE_LOG)
+#undef LOGV
+#undef LOGD
+#undef LOGI
+#undef LOGW
+#undef LOGE
+// The unevaluated call keeps the compiler's format checking.
+#define LOG_RING(prio, ...)                                          \
+    ((void) sizeof(__android_log_print(prio, LOG_TAG, __VA_ARGS__)), \
+     LogRing::Log(prio, LOG_TAG, __VA_ARGS__))
+#define LOGV(...) LOG_RING(ANDROID_LOG_VERBOSE, __VA_ARGS__)
+#define LOGD(...) LOG_RING(ANDROID_LOG_DEBUG, __VA_ARGS__)
+#define LOGI(...) (LogRing::Flush(), __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__))
+#define LOGW(...) (LogRing::Flush(), __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__))
+#define LOGE(...) (LogRing::Flush(), __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__))
+#endif
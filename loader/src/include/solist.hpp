@@ -1,5 +1,6 @@
 #pragma once
 
+#include <optional>
 #include <string>
 
 #include "elf_parser.hpp"
@@ -108,8 +109,12 @@ const size_t size_minimal = 0x100;
 const size_t llvm_suffix_length = 25;
 
 bool initialize();
+// Resolves the linker symbols unless a previous call already did.
+bool ensureInitialized();
 bool findHeuristicOffsets(std::string linker_name, SoInfoWrapper *vdso);
-bool dropSoPath(const char *target_pathn, bool unload);
+// Drops every soinfo record whose path contains `target_path`.
+// `unload` releases them with soinfo_unload instead of soinfo_free.
+bool dropSoPath(const char *target_path, bool unload);
 void resetCounters(size_t load, size_t unload);
 
 }  // namespace Linker
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string_view>
+
+/**
+ * @brief Optional ftrace markers around the phases of NeoZygisk.
+ *
+ * When enabled, each phase writes a begin and an end record to the kernel's `trace_marker` file,
+ * in the format atrace uses, so that the time spent injecting, hooking and specializing shows up
+ * next to scheduler and I/O events in perfetto, systrace or `trace-cmd`.
+ *
+ * The monitor enables markers for the tracer and the injector by setting
+ * `kernel_caps::TRACE_MARKER`. Until `Open()` succeeds, every call is a no-op.
+ */
+namespace trace_marker {
+
+/// Opens `trace_marker` once. Returns false if tracefs is not available.
+bool Open();
+/// Closes the file, so that the descriptor does not outlive NeoZygisk in the traced process.
+void Close();
+bool Enabled();
+
+void Begin(std::string_view name, std::string_view detail = {});
+void End();
+
+/// Marks the lifetime of a scope as one slice.
+class Scope {
+public:
+    explicit Scope(std::string_view name, std::string_view detail = {}) { Begin(name, detail); }
+    /// `detail` may be null, e.g. a nice name that JNI could not convert.
+    Scope(std::string_view name, const char *detail)
+        : Scope(name, detail ? std::string_view(detail) : std::string_view()) {}
+    Scope(std::string_view name, long id);
+    ~Scope() { End(); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+};
+
+}  // namespace trace_marker
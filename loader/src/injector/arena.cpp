@@ -0,0 +1,44 @@
+#include "arena.hpp"
+
+#include <sys/mman.h>
+
+#include <cstdint>
+
+#include "logging.hpp"
+
+SpecializationArena::~SpecializationArena() {
+    if (base_ != nullptr) munmap(base_, CAPACITY);
+}
+
+std::pmr::memory_resource *SpecializationArena::Rewind() {
+    if (base_ == nullptr) {
+        // Only the pages that are actually used ever get backed by memory.
+        void *base = mmap(nullptr, CAPACITY, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) {
+            PLOGE("reserve specialization arena");
+        } else {
+            base_ = base;
+        }
+    }
+    used_ = 0;
+    return this;
+}
+
+void *SpecializationArena::do_allocate(size_t bytes, size_t alignment) {
+    if (base_ != nullptr) {
+        auto start = reinterpret_cast<uintptr_t>(base_);
+        uintptr_t aligned = (start + used_ + alignment - 1) & ~(uintptr_t(alignment) - 1);
+        if (aligned + bytes <= start + CAPACITY) {
+            used_ = aligned + bytes - start;
+            return reinterpret_cast<void *>(aligned);
+        }
+        LOGW("specialization arena exhausted, allocating %zu bytes from the heap", bytes);
+    }
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void SpecializationArena::do_deallocate(void *p, size_t bytes, size_t alignment) {
+    // Arena memory is reclaimed all at once by the next Rewind().
+    if (!owns(p)) std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
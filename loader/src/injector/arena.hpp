@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+/**
+ * @brief A bump allocator for the objects that live during one specialization.
+ *
+ * Everything a ZygiskContext allocates is short-lived and released together when the context is
+ * destroyed, so it is carved from a private anonymous reservation instead of the app's heap:
+ * allocating is a pointer bump, deallocating is a no-op, and the heap of the specialized process
+ * is left exactly as zygote made it.
+ *
+ * The reservation is made once in zygote and rewound at the start of every specialization, so
+ * forking does not pay for a new mapping. It is released with a single `munmap` when the
+ * injector unloads itself. Requests that do not fit fall back to the regular heap.
+ */
+class SpecializationArena final : public std::pmr::memory_resource {
+public:
+    static constexpr size_t CAPACITY = 1 << 20;
+
+    SpecializationArena() = default;
+    ~SpecializationArena() override;
+
+    SpecializationArena(const SpecializationArena &) = delete;
+    SpecializationArena &operator=(const SpecializationArena &) = delete;
+
+    /// Discards every previous allocation and returns the arena, ready for a new specialization.
+    std::pmr::memory_resource *Rewind();
+
+private:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+    bool owns(const void *p) const {
+        return base_ != nullptr && p >= base_ && p < static_cast<const char *>(base_) + CAPACITY;
+    }
+
+    void *base_ = nullptr;
+    size_t used_ = 0;
+};
@@ -9,8 +9,35 @@
 #include "solist.hpp"
 #include "zygisk.hpp"
 
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+
+/**
+ * @brief Cleanup targets that do not change between forks.
+ *
+ * Locating them means parsing libc and the linker from disk, which would otherwise be repeated in
+ * every child. Zygote resolves them once in `prepare_cleanup_plan()`; children inherit the result
+ * and only do the actual cleanup work.
+ *
+ * Module soinfos and mappings are created after the fork, so they are still looked up by the child.
+ */
+static struct {
+    bool prepared = false;
+    Atexit::AtexitArray *atexit_array = nullptr;
+} g_cleanup_plan;
+
+void prepare_cleanup_plan() {
+    g_cleanup_plan.atexit_array = Atexit::findAtexitArray();
+    if (!Linker::ensureInitialized()) {
+        LOGW("failed to resolve the linker state, children will retry");
+    }
+    g_cleanup_plan.prepared = true;
+}
+
 void clean_libc_trace() {
-    auto g_array = Atexit::findAtexitArray();
+    auto g_array = g_cleanup_plan.prepared ? g_cleanup_plan.atexit_array
+                                           : Atexit::findAtexitArray();
     if (g_array != nullptr) {
         g_array->recompact();
         LOGV("g_array after recompact: %s", g_array->format_state_string().c_str());
@@ -29,17 +56,23 @@ void clean_linker_trace(const char *path, size_t loaded_modules, size_t unloaded
     }
 }
 
-void spoof_virtual_maps(const char *path, bool clear_write_permission) {
+void spoof_virtual_maps(const char *path, bool clear_write_permission, const void *skip_start,
+                        size_t skip_size) {
     // spoofing map path names is futile in Android, we do it simply
     // to avoid trivial Zygisk detections based on string comparison.
+    auto skip_begin = reinterpret_cast<uintptr_t>(skip_start);
     for (auto &map : lsplt::MapInfo::Scan()) {
         void *addr = (void *) map.start;
         size_t size = map.end - map.start;
+        // Swapping a copy over code that is running, such as the caller, would fault.
+        if (map.start < skip_begin + skip_size && skip_begin < map.end) continue;
 
         if (strstr(map.path.c_str(), path)) {
             LOGV("spoofing entry path contaning string %s", map.path.c_str());
-            // Create an anonymous mapping to hold a copy of the original data
-            void *copy = mmap(nullptr, size, PROT_WRITE, MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+            // Create an anonymous mapping to hold a copy of the original data. It is populated
+            // upfront, so the copy below does not take a page fault for every page it writes.
+            void *copy = mmap(nullptr, size, PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_POPULATE,
+                              -1, 0);
             if (copy == MAP_FAILED) {
                 LOGE("failed to backup block %s [%p, %p]", map.path.c_str(), addr,
                      (void *) map.end);
@@ -49,6 +82,9 @@ void spoof_virtual_maps(const char *path, bool clear_write_permission) {
             if ((map.perms & PROT_READ) == 0) {
                 mprotect(addr, size, PROT_READ);
             }
+            // Fault in the source in one pass as well; older kernels reject the advice and the
+            // copy simply faults as before.
+            madvise(addr, size, MADV_POPULATE_READ);
             memcpy(copy, addr, size);
             // Overwrite the original mapping with our anonymous copy
             if (mremap(copy, size, size, MREMAP_MAYMOVE | MREMAP_FIXED, addr) == MAP_FAILED) {
@@ -1,15 +1,20 @@
 #include <dlfcn.h>
 
 #include "daemon.hpp"
+#include "kernel_caps.hpp"
 #include "logging.hpp"
+#include "trace_marker.hpp"
 #include "zygisk.hpp"
 
 using namespace std;
 
 extern "C" [[gnu::visibility("default")]]
-void entry(void* addr, size_t size, const char* path) {
+void entry(void* addr, size_t size, const char* path, uint32_t kernel_caps) {
     LOGI("zygisk library injected, version %s", ZKSU_VERSION);
 
+    if (kernel_caps & kernel_caps::TRACE_MARKER) trace_marker::Open();
+    trace_marker::Scope trace("zygisk:entry");
+
     zygiskd::Init(path);
 
     if (!zygiskd::PingHeartbeat()) {
@@ -17,8 +22,8 @@ void entry(void* addr, size_t size, const char* path) {
         return;
     }
 
-    hook_entry(addr, size);
-    send_seccomp_event_if_needed();
+    hook_entry(addr, size, kernel_caps);
+    send_seccomp_event_if_needed(kernel_caps);
 }
 
 /**
@@ -4,14 +4,18 @@
 #include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/resource.h>
+#include <time.h>
 #include <unistd.h>
 #include <unwind.h>
 
+#include <algorithm>
+
 #include <lsplt.hpp>
 
 #include "android_util.hpp"
 #include "daemon.hpp"
 #include "module.hpp"
+#include "trace_marker.hpp"
 #include "zygisk.hpp"
 
 using namespace std;
@@ -127,8 +131,8 @@ DCL_HOOK_FUNC(int, property_get, const char *key, char *value, const char *defau
         for (auto it = g_hook->plt_backup.rbegin(); it != g_hook->plt_backup.rend(); ++it) {
             const auto &[dev, inode, sym, old_func] = *it;
             if (*old_func == old_property_get) {
-                if (!lsplt::RegisterHook(dev, inode, sym, *old_func, nullptr) ||
-                    !lsplt::CommitHook(g_hook->cached_map_infos, true)) {
+                if (!g_hook->register_plt_hook(dev, inode, sym, *old_func, nullptr) ||
+                    !g_hook->commit_plt_hooks("unhook property_get")) {
                     PLOGE("unhook property_get");
                 } else {
                     // A reverse_iterator must be converted to a forward iterator.
@@ -157,7 +161,7 @@ DCL_HOOK_FUNC(static int, pthread_attr_setstacksize, void *target, size_t size)
             size_t block_size = g_hook->block_size;
 
             if (g_hook->should_spoof_maps) {
-                spoof_virtual_maps("jit-cache-zygisk", true);
+                spoof_virtual_maps("jit-cache-zygisk", true, start_addr, block_size);
             }
 
             delete g_hook;
@@ -165,6 +169,8 @@ DCL_HOOK_FUNC(static int, pthread_attr_setstacksize, void *target, size_t size)
             // signature, we can use `musttail` to let the compiler reuse our stack frame and thus
             // `munmap` will directly return to the caller of `pthread_attr_setstacksize`.
             LOGV("unmap libzygisk.so loaded at %p with size %zu", start_addr, block_size);
+            // Pending log records and their format strings are about to be unmapped.
+            LogRing::Flush();
             [[clang::musttail]] return munmap(start_addr, block_size);
         }
         delete g_hook;
@@ -183,14 +189,21 @@ static size_t get_fd_max() {
 }
 
 ZygiskContext::ZygiskContext(JNIEnv *env, void *args)
-    : env(env),
+    : arena(g_hook->specialization_arena.Rewind()),
+      env(env),
       args{args},
       process(nullptr),
+      modules(arena),
       pid(-1),
       flags(0),
       info_flags(0),
-      allowed_fds(get_fd_max()),
-      hook_info_lock(PTHREAD_MUTEX_INITIALIZER) {
+      flags_query(-1),
+      flags_query_sent{},
+      allowed_fds(get_fd_max(), arena),
+      exempted_fds(arena),
+      hook_info_lock(PTHREAD_MUTEX_INITIALIZER),
+      register_info(arena),
+      ignore_info(arena) {
     g_ctx = this;
 }
 
@@ -202,6 +215,9 @@ ZygiskContext::~ZygiskContext() {
 
     if (!is_child()) return;
 
+    // Markers end with the specialization; the app gets no descriptor from us.
+    trace_marker::Close();
+
     // Strip out all API function pointers
     for (auto &m : modules) {
         m.clearApi();
@@ -214,8 +230,8 @@ ZygiskContext::~ZygiskContext() {
 
 // -----------------------------------------------------------------
 
-HookContext::HookContext(void *start_addr, size_t block_size)
-    : start_addr{start_addr}, block_size{block_size} {};
+HookContext::HookContext(void *start_addr, size_t block_size, uint32_t kernel_caps)
+    : start_addr{start_addr}, block_size{block_size}, kernel_caps{kernel_caps} {};
 
 // -----------------------------------------------------------------
 
@@ -237,13 +253,57 @@ inline void *unwind_get_region_start(_Unwind_Context *ctx) {
 
 void HookContext::register_hook(dev_t dev, ino_t inode, const char *symbol, void *new_func,
                                 void **old_func) {
-    if (!lsplt::RegisterHook(dev, inode, symbol, new_func, old_func)) {
+    if (!register_plt_hook(dev, inode, symbol, new_func, old_func)) {
         LOGE("failed to register plt_hook \"%s\"\n", symbol);
         return;
     }
     plt_backup.emplace_back(dev, inode, symbol, old_func);
 }
 
+bool HookContext::register_plt_hook(dev_t dev, ino_t inode, const char *symbol, void *callback,
+                                    void **backup) {
+    if (!plt_hooks.Register(dev, inode, symbol, callback, backup)) return false;
+    pending_plt_targets.emplace_back(dev, inode);
+    return true;
+}
+
+/**
+ * @brief Applies every pending PLT hook in a single commit.
+ *
+ * Hooks are only registered against libraries, so the cached maps are enough unless one of the
+ * targets was loaded after they were scanned; only then are the maps scanned again. The cost of
+ * each commit is logged, as modules may commit many times while specializing.
+ */
+bool HookContext::commit_plt_hooks(const char *reason) {
+    struct timespec begin{}, end{};
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    std::sort(pending_plt_targets.begin(), pending_plt_targets.end());
+    size_t hooks = pending_plt_targets.size();
+    pending_plt_targets.erase(std::unique(pending_plt_targets.begin(), pending_plt_targets.end()),
+                              pending_plt_targets.end());
+    std::pmr::memory_resource *arena = &specialization_arena;
+    std::pmr::vector<bool> mapped(pending_plt_targets.size(), arena);
+    for (auto &map : cached_map_infos) {
+        auto it = std::lower_bound(pending_plt_targets.begin(), pending_plt_targets.end(),
+                                   std::make_pair(map.dev, map.inode));
+        if (it != pending_plt_targets.end() && *it == std::make_pair(map.dev, map.inode)) {
+            mapped[it - pending_plt_targets.begin()] = true;
+        }
+    }
+    bool rescanned = std::find(mapped.begin(), mapped.end(), false) != mapped.end();
+    if (rescanned) cached_map_infos = lsplt::MapInfo::Scan();
+
+    bool ok = plt_hooks.Commit(cached_map_infos);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    LOGV("plt commit [%s]: %zu hooks in %zu libraries%s, %.2fms", reason, hooks,
+         pending_plt_targets.size(), rescanned ? " (maps rescanned)" : "",
+         (end.tv_sec - begin.tv_sec) * 1e3 + (end.tv_nsec - begin.tv_nsec) / 1e6);
+    pending_plt_targets.clear();
+    return ok;
+}
+
 #define PLT_HOOK_REGISTER_SYM(DEV, INODE, SYM, NAME)                                               \
     register_hook(DEV, INODE, SYM, reinterpret_cast<void *>(new_##NAME),                           \
                   reinterpret_cast<void **>(&old_##NAME))
@@ -267,7 +327,7 @@ void HookContext::hook_plt() {
     PLT_HOOK_REGISTER(android_runtime_dev, android_runtime_inode, strdup);
     PLT_HOOK_REGISTER(android_runtime_dev, android_runtime_inode, property_get);
 
-    if (!lsplt::CommitHook(cached_map_infos)) LOGE("HookContext::hook_plt failed");
+    if (!commit_plt_hooks("hook_plt")) LOGE("HookContext::hook_plt failed");
 
     // Remove unhooked methods
     plt_backup.erase(std::remove_if(plt_backup.begin(), plt_backup.end(),
@@ -279,17 +339,24 @@ void HookContext::hook_unloader() {
     ino_t art_inode = 0;
     dev_t art_dev = 0;
 
-    cached_map_infos = lsplt::MapInfo::Scan();
-    for (auto &map : cached_map_infos) {
-        if (map.path.ends_with("/libart.so")) {
-            art_inode = map.inode;
-            art_dev = map.dev;
-            break;
+    // libart is normally in the maps cached at ZygoteInit already; only scan if it is not.
+    auto find_art = [&] {
+        for (auto &map : cached_map_infos) {
+            if (map.path.ends_with("/libart.so")) {
+                art_inode = map.inode;
+                art_dev = map.dev;
+                return true;
+            }
         }
+        return false;
+    };
+    if (!find_art()) {
+        cached_map_infos = lsplt::MapInfo::Scan();
+        find_art();
     }
 
     PLT_HOOK_REGISTER(art_dev, art_inode, pthread_attr_setstacksize);
-    if (!lsplt::CommitHook(cached_map_infos)) {
+    if (!commit_plt_hooks("hook_unloader")) {
         LOGE("HookContext::hook_unloader failed");
     }
 }
@@ -297,12 +364,12 @@ void HookContext::hook_unloader() {
 void HookContext::restore_plt_hook() {
     // Unhook plt_hook
     for (const auto &[dev, inode, sym, old_func] : plt_backup) {
-        if (!lsplt::RegisterHook(dev, inode, sym, *old_func, nullptr)) {
+        if (!register_plt_hook(dev, inode, sym, *old_func, nullptr)) {
             LOGE("failed to register plt_hook [%s]", sym);
             should_unmap = false;
         }
     }
-    if (!lsplt::CommitHook(cached_map_infos, true)) {
+    if (!commit_plt_hooks("restore_plt_hook")) {
         LOGE("failed to restore plt_hook");
         should_unmap = false;
     }
@@ -355,6 +422,7 @@ void HookContext::hook_jni_methods(JNIEnv *env, const char *clz, JNIMethods meth
 }
 
 void HookContext::hook_zygote_jni() {
+    trace_marker::Scope trace("zygisk:hook_zygote_jni");
     auto get_created_java_vms = reinterpret_cast<jint (*)(JavaVM **, jsize, jsize *)>(
         dlsym(RTLD_DEFAULT, "JNI_GetCreatedJavaVMs"));
     if (!get_created_java_vms) {
@@ -406,10 +474,16 @@ void HookContext::restore_zygote_hook(JNIEnv *env) {
 
 // -----------------------------------------------------------------
 
-void hook_entry(void *start_addr, size_t block_size) {
-    g_hook = new HookContext(start_addr, block_size);
+void hook_entry(void *start_addr, size_t block_size, uint32_t kernel_caps) {
+    g_hook = new HookContext(start_addr, block_size, kernel_caps);
     g_hook->hook_plt();
-    clean_linker_trace(zygiskd::GetTmpPath().data(), 1, 0, true);
+    // If the tracer mapped us without the linker, there is no soinfo or counter to clean up.
+    Dl_info info;
+    if (dladdr((void *) &hook_entry, &info) != 0) {
+        clean_linker_trace(zygiskd::GetTmpPath().data(), 1, 0, true);
+    }
+    // Resolve the fork-invariant cleanup targets once, so that children inherit them.
+    prepare_cleanup_plan();
 }
 
 void hookJniNativeMethods(JNIEnv *env, const char *clz, JNINativeMethod *methods, int numMethods) {
@@ -6,18 +6,28 @@
 #include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <set>
+
 #include <lsplt.hpp>
 
 #include "daemon.hpp"
 #include "dl.hpp"
 #include "files.hpp"
+#include "kernel_caps.hpp"
 #include "logging.hpp"
 #include "misc.hpp"
+#include "trace_marker.hpp"
 #include "zygisk.hpp"
 
+#ifndef __NR_close_range
+#define __NR_close_range 436
+#endif
+
 using namespace std;
 
 ZygiskModule::ZygiskModule(int id, void *handle, void *entry)
@@ -38,6 +48,18 @@ bool ZygiskModule::RegisterModuleImpl(ApiTable *api, long *module) {
     // Set the actual module_abi*
     api->base.impl->mod = {module};
 
+    if (api->base.impl->in_zygote) {
+        // Fail the registration so that the entry skips onLoad; onZygoteLoad only gets the
+        // module directory, as nothing else makes sense before a process is specialized.
+        if (api_version >= 2) {
+            api->v2.getModuleDir = [](ZygiskModule *m) { return m->getModuleDir(); };
+        }
+        if (api_version >= 6) {
+            api->v6.getConfig = [](ZygiskModule *m, size_t *size) { return m->getConfig(size); };
+        }
+        return false;
+    }
+
     // Fill in API accordingly with module API version
     if (api_version >= 1) {
         api->v1.hookJniNativeMethods = hookJniNativeMethods;
@@ -56,14 +78,17 @@ bool ZygiskModule::RegisterModuleImpl(ApiTable *api, long *module) {
         api->v2.getFlags = [](auto) { return ZygiskModule::getFlags(); };
     }
     if (api_version >= 4) {
-        api->v4.pltHookCommit = []() { return lsplt::CommitHook(g_hook->cached_map_infos); };
+        api->v4.pltHookCommit = []() { return g_hook->commit_plt_hooks("module"); };
         api->v4.pltHookRegister = [](dev_t dev, ino_t inode, const char *symbol, void *fn,
                                      void **backup) {
             if (dev == 0 || inode == 0 || symbol == nullptr || fn == nullptr) return;
-            lsplt::RegisterHook(dev, inode, symbol, fn, backup);
+            g_hook->register_plt_hook(dev, inode, symbol, fn, backup);
         };
         api->v4.exemptFd = [](int fd) { return g_ctx && g_ctx->exempt_fd(fd); };
     }
+    if (api_version >= 6) {
+        api->v6.getConfig = [](ZygiskModule *m, size_t *size) { return m->getConfig(size); };
+    }
 
     return true;
 }
@@ -71,6 +96,9 @@ bool ZygiskModule::RegisterModuleImpl(ApiTable *api, long *module) {
 bool ZygiskModule::valid() const {
     if (mod.api_version == nullptr) return false;
     switch (*mod.api_version) {
+    case 6:
+        if (mod.v6->onZygoteLoad == nullptr || mod.v6->api == nullptr) return false;
+        [[fallthrough]];
     case 5:
     case 4:
     case 3:
@@ -83,12 +111,45 @@ bool ZygiskModule::valid() const {
     }
 }
 
+void ZygiskModule::onZygoteLoad(JNIEnv *env) {
+    in_zygote = true;
+    entry.fn(&api, env);
+    in_zygote = false;
+    if (valid() && *mod.api_version >= 6) mod.v6->onZygoteLoad(mod.v6->impl, mod.v6->api, env);
+    // The module keeps a pointer to this table; leave nothing callable behind in zygote.
+    clearApi();
+}
+
 /* Zygisksu changed: Use own zygiskd */
 int ZygiskModule::connectCompanion() const { return zygiskd::ConnectCompanion(id); }
 
 /* Zygisksu changed: Use own zygiskd */
 int ZygiskModule::getModuleDir() const { return zygiskd::GetModuleDir(id); }
 
+const void *ZygiskModule::getConfig(size_t *size) const {
+    if (size != nullptr) *size = config_size;
+    return config;
+}
+
+void ZygiskModule::attachConfig(int fd) {
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) == -1 || st.st_size <= 0) return;
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        PLOGE("map config of module %d", id);
+        return;
+    }
+    config = addr;
+    config_size = st.st_size;
+}
+
+void ZygiskModule::releaseConfig() {
+    // Leave no mapping of the blob behind in the specialized process.
+    if (config != nullptr) munmap(const_cast<void *>(config), config_size);
+    config = nullptr;
+    config_size = 0;
+}
+
 void ZygiskModule::setOption(zygisk::Option opt) {
     if (g_ctx == nullptr) return;
     switch (opt) {
@@ -138,39 +199,142 @@ void ZygiskModule::postServerSpecialize(const ServerSpecializeArgs_v1 *args) con
 
 // -----------------------------------------------------------------
 
+/**
+ * @brief Finds the longest run of plain characters that every match of `pattern` contains.
+ *
+ * The scan is deliberately conservative: anything it does not fully understand (alternations,
+ * bracket expressions, back-references) ends the current run or the whole scan, and a character
+ * followed by a quantifier is never part of a run. An empty result disables the prefilter.
+ */
+static std::pmr::string required_literal(const char *pattern, bool &is_suffix,
+                                         std::pmr::memory_resource *arena) {
+    std::pmr::string best(arena), run(arena);
+    int depth = 0;
+    is_suffix = false;
+    auto end_run = [&] {
+        if (run.size() > best.size()) best = run;
+        run.clear();
+    };
+    auto skip_quantified = [&] {
+        // The preceding character is optional or repeated, so it cannot be required as is.
+        if (!run.empty()) run.pop_back();
+        end_run();
+    };
+
+    for (const char *p = pattern; *p;) {
+        char c = *p++;
+        if (c == '\\') {
+            if (*p == '\0') break;
+            c = *p++;
+            if (c == '(' || c == ')') {
+                depth += c == '(' ? 1 : -1;
+                end_run();
+                continue;
+            }
+            if (c == '|') return {};
+            if (c == '{' || c == '?' || c == '+') {
+                skip_quantified();
+                while (*p && *p != '}') p++;
+                if (*p) p++;
+                continue;
+            }
+            if (isalnum(static_cast<unsigned char>(c)) || c == '<' || c == '>' || c == '`' ||
+                c == '\'') {
+                end_run();
+                continue;
+            }
+        } else if (c == '|') {
+            return {};
+        } else if (c == '(' || c == ')') {
+            depth += c == '(' ? 1 : -1;
+            end_run();
+            continue;
+        } else if (c == '*' || c == '?' || c == '+' || c == '{') {
+            skip_quantified();
+            if (c == '{') {
+                while (*p && *p != '}') p++;
+                if (*p) p++;
+            }
+            continue;
+        } else if (c == '[') {
+            end_run();
+            return best;
+        } else if (c == '$' && *p == '\0' && depth == 0) {
+            if (!run.empty() && run.size() >= best.size()) {
+                is_suffix = true;
+                return run;
+            }
+            break;
+        } else if (c == '.' || c == '^' || c == '$') {
+            end_run();
+            continue;
+        }
+        if (depth == 0) run += c;
+    }
+    end_run();
+    return best;
+}
+
+bool ZygiskContext::PathRegex::compile(const char *pattern) {
+    if (regcomp(&regex, pattern, REG_NOSUB) != 0) return false;
+    literal = required_literal(pattern, literal_is_suffix, literal.get_allocator().resource());
+    return true;
+}
+
+bool ZygiskContext::PathRegex::matches(const std::string &path) const {
+    std::string_view needle = literal;
+    if (literal_is_suffix ? !path.ends_with(needle) : path.find(needle) == std::string::npos) {
+        return false;
+    }
+    return regexec(&regex, path.data(), 0, nullptr, 0) == 0;
+}
+
 void ZygiskContext::plt_hook_register(const char *regex, const char *symbol, void *fn,
                                       void **backup) {
     if (regex == nullptr || symbol == nullptr || fn == nullptr) return;
-    regex_t re;
-    if (regcomp(&re, regex, REG_NOSUB) != 0) return;
+    PathRegex re(arena);
+    if (!re.compile(regex)) return;
     mutex_guard lock(hook_info_lock);
-    register_info.emplace_back(RegisterInfo{re, symbol, fn, backup});
+    register_info.emplace_back(
+        RegisterInfo{std::move(re), std::pmr::string(symbol, arena), fn, backup});
 }
 
 void ZygiskContext::plt_hook_exclude(const char *regex, const char *symbol) {
     if (!regex) return;
-    regex_t re;
-    if (regcomp(&re, regex, REG_NOSUB) != 0) return;
+    PathRegex re(arena);
+    if (!re.compile(regex)) return;
     mutex_guard lock(hook_info_lock);
-    ignore_info.emplace_back(IgnoreInfo{re, symbol ?: ""});
+    ignore_info.emplace_back(IgnoreInfo{std::move(re), std::pmr::string(symbol ?: "", arena)});
 }
 
 void ZygiskContext::plt_hook_process_regex() {
     if (register_info.empty()) return;
+    // Hooks are registered per (dev, inode), so every library only has to be matched once.
+    std::pmr::set<std::pair<dev_t, ino_t>> seen(arena);
+    // Whether each ignore pattern matches the current path, evaluated at most once per path.
+    enum : int8_t { UNKNOWN = -1, NO, YES };
+    std::pmr::vector<int8_t> ignore_matches(ignore_info.size(), arena);
     for (auto &map : g_hook->cached_map_infos) {
         if (map.offset != 0 || !map.is_private || !(map.perms & PROT_READ)) continue;
+        if (!seen.emplace(map.dev, map.inode).second) continue;
+        std::fill(ignore_matches.begin(), ignore_matches.end(), UNKNOWN);
         for (auto &reg : register_info) {
-            if (regexec(&reg.regex, map.path.data(), 0, nullptr, 0) != 0) continue;
+            if (!reg.regex.matches(map.path)) continue;
             bool ignored = false;
-            for (auto &ign : ignore_info) {
-                if (regexec(&ign.regex, map.path.data(), 0, nullptr, 0) != 0) continue;
+            for (size_t i = 0; i < ignore_info.size(); i++) {
+                auto &ign = ignore_info[i];
+                if (ignore_matches[i] == UNKNOWN) {
+                    ignore_matches[i] = ign.regex.matches(map.path) ? YES : NO;
+                }
+                if (ignore_matches[i] == NO) continue;
                 if (ign.symbol.empty() || ign.symbol == reg.symbol) {
                     ignored = true;
                     break;
                 }
             }
             if (!ignored) {
-                lsplt::RegisterHook(map.dev, map.inode, reg.symbol, reg.callback, reg.backup);
+                g_hook->register_plt_hook(map.dev, map.inode, reg.symbol.data(), reg.callback,
+                                          reg.backup);
             }
         }
     }
@@ -183,7 +347,7 @@ bool ZygiskContext::plt_hook_commit() {
         register_info.clear();
         ignore_info.clear();
     }
-    return lsplt::CommitHook(g_hook->cached_map_infos);
+    return g_hook->commit_plt_hooks("module regex");
 }
 
 // -----------------------------------------------------------------
@@ -228,6 +392,17 @@ void ZygiskContext::sanitize_fds() {
     }
 
     // Close all forbidden fds to prevent crashing
+    if (g_hook->kernel_caps & kernel_caps::CLOSE_RANGE) {
+        // Close every run of forbidden fds with one syscall, without listing /proc/self/fd.
+        size_t start = 0;
+        for (size_t fd = 0; fd <= allowed_fds.size(); ++fd) {
+            if (fd < allowed_fds.size() && !allowed_fds[fd]) continue;
+            if (fd > start) syscall(__NR_close_range, start, fd - 1, 0);
+            start = fd + 1;
+        }
+        syscall(__NR_close_range, allowed_fds.size(), ~0U, 0);
+        return;
+    }
     auto dir = open_dir("/proc/self/fd");
     int dfd = dirfd(dir.get());
     for (dirent *entry; (entry = readdir(dir.get()));) {
@@ -262,9 +437,17 @@ void ZygiskContext::fork_pre() {
     // Do our own fork before loading any 3rd party code
     // First block SIGCHLD, unblock after original fork is done
     sigmask(SIG_BLOCK, SIGCHLD);
+    if (!g_hook->zygote_modules_loaded) load_zygote_modules();
+    // Write out pending log records now, or both processes would end up writing them
+    LogRing::Flush();
     pid = old_fork();
 
-    if (!is_child()) return;
+    if (!is_child()) {
+        // The pending flag query is the child's; zygote must not keep the connection open.
+        if (flags_query >= 0) close(flags_query);
+        flags_query = -1;
+        return;
+    }
 
     // Record all open fds
     auto dir = xopen_dir("/proc/self/fd");
@@ -278,6 +461,8 @@ void ZygiskContext::fork_pre() {
     }
     // The dirfd will be closed once out of scope
     allowed_fds[dirfd(dir.get())] = false;
+    // Closed once the reply is read, and never handed over to the app
+    if (flags_query >= 0) allowed_fds[flags_query] = false;
 }
 
 void ZygiskContext::fork_post() {
@@ -285,19 +470,48 @@ void ZygiskContext::fork_post() {
     sigmask(SIG_UNBLOCK, SIGCHLD);
 }
 
-/* Zygisksu changed: Load module fds */
-void ZygiskContext::run_modules_pre() {
-    auto ms = zygiskd::ReadModules();
-    auto size = ms.size();
-    for (size_t i = 0; i < size; i++) {
-        auto &m = ms[i];
+/**
+ * @brief Loads the modules that asked to be preloaded into zygote, before its first fork.
+ *
+ * Each module's onZygoteLoad() runs once here, and every child inherits what it built. Children
+ * then reuse these libraries instead of loading them again.
+ */
+void ZygiskContext::load_zygote_modules() {
+    g_hook->zygote_modules_loaded = true;
+    trace_marker::Scope trace("zygisk:load_zygote_modules");
+    for (auto &m : zygiskd::ReadModules()) {
+        if (!m.preload) continue;
         if (void *handle = DlopenMem(m.memfd, RTLD_NOW);
             void *entry = handle ? dlsym(handle, "zygisk_module_entry") : nullptr) {
-            modules.emplace_back(i, handle, entry);
+            LOGI("module %s preloaded into zygote", m.name.c_str());
+            auto &module = g_hook->zygote_modules.emplace_back(m.index, handle, entry);
+            module.attachConfig(m.config_fd);
+            module.onZygoteLoad(env);
+            module.releaseConfig();
+        }
+    }
+}
+
+/* Zygisksu changed: Load module fds */
+void ZygiskContext::run_modules_pre() {
+    {
+        trace_marker::Scope trace("zygisk:load_modules");
+        for (auto &m : zygiskd::ReadModules()) {
+            auto resident = std::find_if(
+                g_hook->zygote_modules.begin(), g_hook->zygote_modules.end(),
+                [&](const ZygiskModule &z) { return z.getId() == static_cast<int>(m.index); });
+            if (resident != g_hook->zygote_modules.end()) {
+                modules.emplace_back(m.index, resident->getHandle(), resident->getEntry())
+                    .attachConfig(m.config_fd);
+            } else if (void *handle = DlopenMem(m.memfd, RTLD_NOW);
+                       void *entry = handle ? dlsym(handle, "zygisk_module_entry") : nullptr) {
+                modules.emplace_back(m.index, handle, entry).attachConfig(m.config_fd);
+            }
         }
     }
 
     for (auto &m : modules) {
+        trace_marker::Scope trace("zygisk:module_pre", m.getId());
         m.onLoad(env);
         if (flags & APP_SPECIALIZE) {
             m.preAppSpecialize(args.app);
@@ -311,16 +525,19 @@ void ZygiskContext::run_modules_post() {
     flags |= POST_SPECIALIZE;
 
     size_t modules_unloaded = 0;
-    for (const auto &m : modules) {
+    for (auto &m : modules) {
+        trace_marker::Scope trace("zygisk:module_post", m.getId());
         if (flags & APP_SPECIALIZE) {
             m.postAppSpecialize(args.app);
         } else if (flags & SERVER_FORK_AND_SPECIALIZE) {
             m.postServerSpecialize(args.server);
         }
+        m.releaseConfig();
         if (m.tryUnload()) modules_unloaded++;
     }
 
     if (modules.size() > 0) {
+        trace_marker::Scope trace("zygisk:cleanup");
         LOGV("modules unloaded: %zu/%zu", modules_unloaded, modules.size());
         if (modules.size() == modules_unloaded) clean_libc_trace();
         clean_linker_trace("jit-cache-zygisk", modules.size(), modules_unloaded, true);
@@ -329,9 +546,9 @@ void ZygiskContext::run_modules_post() {
     }
 }
 
-void ZygiskContext::app_specialize_pre() {
+/// The uid whose flags apply to the app; isolated services take the uid of their data dir.
+uid_t ZygiskContext::resolve_app_uid() const {
     uid_t uid = args.app->uid;
-    // Correct uid for isolated services
     if (uid >= AID_ISOLATED_START && uid <= AID_ISOLATED_END && args.app->app_data_dir) {
         const char *data_dir = nullptr;
         data_dir = env->GetStringUTFChars(args.app->app_data_dir, nullptr);
@@ -344,8 +561,27 @@ void ZygiskContext::app_specialize_pre() {
             env->ReleaseStringUTFChars(args.app->app_data_dir, data_dir);
         }
     }
+    return uid;
+}
+
+static double elapsed_ms(const struct timespec &begin, const struct timespec &end) {
+    return (end.tv_sec - begin.tv_sec) * 1e3 + (end.tv_nsec - begin.tv_nsec) / 1e6;
+}
 
-    if (info_flags == 0) info_flags = zygiskd::GetProcessFlags(uid);
+void ZygiskContext::app_specialize_pre() {
+    trace_marker::Scope trace("zygisk:app_specialize_pre", process);
+    if (info_flags == 0 && flags_query >= 0) {
+        trace_marker::Scope trace_flags("zygisk:process_flags");
+        struct timespec asked, answered;
+        clock_gettime(CLOCK_MONOTONIC, &asked);
+        info_flags = zygiskd::ReadProcessFlags(flags_query);
+        flags_query = -1;
+        clock_gettime(CLOCK_MONOTONIC, &answered);
+        // The first figure is the round-trip time the pipelined query took off this path.
+        LOGV("process flags in flight for %.3fms before needed, waited %.3fms more",
+             elapsed_ms(flags_query_sent, asked), elapsed_ms(asked, answered));
+    }
+    if (info_flags == 0) info_flags = zygiskd::GetProcessFlags(resolve_app_uid());
 
     if ((info_flags & UNMOUNT_MASK) == UNMOUNT_MASK) {
         LOGI("[%s] is on the denylist", process);
@@ -357,6 +593,7 @@ void ZygiskContext::app_specialize_pre() {
 }
 
 void ZygiskContext::app_specialize_post() {
+    trace_marker::Scope trace("zygisk:app_specialize_post", process);
     run_modules_post();
 
     if ((info_flags & PROCESS_IS_MANAGER) == PROCESS_IS_MANAGER) {
@@ -369,11 +606,15 @@ void ZygiskContext::app_specialize_post() {
 }
 
 void ZygiskContext::server_specialize_pre() {
+    trace_marker::Scope trace("zygisk:server_specialize_pre");
     run_modules_pre();
     zygiskd::SystemServerStarted();
 }
 
-void ZygiskContext::server_specialize_post() { run_modules_post(); }
+void ZygiskContext::server_specialize_post() {
+    trace_marker::Scope trace("zygisk:server_specialize_post");
+    run_modules_post();
+}
 
 // -----------------------------------------------------------------
 
@@ -444,6 +685,7 @@ void ZygiskContext::nativeForkAndSpecialize_pre() {
     flags |= APP_FORK_AND_SPECIALIZE;
 
     if (!g_hook->zygote_unmounted && g_hook->zygote_traces.size() == 0) {
+        trace_marker::Scope trace("zygisk:unmount_zygote");
         info_flags = zygiskd::GetProcessFlags(args.app->uid);
 
         g_hook->zygote_traces = check_zygote_traces(info_flags);
@@ -467,6 +709,12 @@ void ZygiskContext::nativeForkAndSpecialize_pre() {
         }
     }
 
+    // Ask for the flags now, so that the daemon answers while zygote forks and the child only
+    // has to read the reply; the unmount check above may already have fetched them.
+    if (info_flags == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &flags_query_sent);
+        flags_query = zygiskd::RequestProcessFlags(resolve_app_uid());
+    }
     fork_pre();
     if (is_child()) {
         app_specialize_pre();
@@ -488,6 +736,7 @@ void ZygiskContext::nativeForkAndSpecialize_post() {
 bool ZygiskContext::update_mount_namespace(zygiskd::MountNamespace namespace_type) {
     const char* type_str = (namespace_type == zygiskd::MountNamespace::Clean ? "Clean" : "Root");
     LOGV("updating mount namespace to type %s", type_str);
+    trace_marker::Scope trace("zygisk:setns", type_str);
 
     int ns_fd = zygiskd::UpdateMountNamespace(namespace_type);
 
@@ -4,12 +4,15 @@
 
 #include <bitset>
 #include <list>
+#include <memory_resource>
 #include <span>
 #include <vector>
 
 #include "api.hpp"
+#include "arena.hpp"
 #include "daemon.hpp"
 #include "lsplt.hpp"
+#include "plt_hook.hpp"
 #include "zygisk.hpp"
 
 struct ZygiskContext;
@@ -27,12 +30,14 @@ using module_abi_v2 = module_abi_v1;
 using module_abi_v3 = module_abi_v1;
 using module_abi_v4 = module_abi_v1;
 using module_abi_v5 = module_abi_v1;
+struct module_abi_v6;
 
 struct api_abi_v1;
 struct api_abi_v2;
 using api_abi_v3 = api_abi_v2;
 struct api_abi_v4;
 using api_abi_v5 = api_abi_v4;
+struct api_abi_v6;
 
 union ApiTable;
 
@@ -144,6 +149,11 @@ struct module_abi_v1 {
     void (*postServerSpecialize)(void *, const void *);
 };
 
+struct module_abi_v6 : public module_abi_v1 {
+    void (*onZygoteLoad)(void *, void *, JNIEnv *);
+    void *api;
+};
+
 enum : uint32_t {
     PROCESS_GRANTED_ROOT = zygisk::StateFlag::PROCESS_GRANTED_ROOT,
     PROCESS_ON_DENYLIST = zygisk::StateFlag::PROCESS_ON_DENYLIST,
@@ -188,15 +198,21 @@ struct api_abi_v4 : public api_abi_base {
     /* 7 */ uint32_t (*getFlags)(ZygiskModule *);
 };
 
+struct api_abi_v6 : public api_abi_v4 {
+    /* 8 */ const void *(*getConfig)(ZygiskModule *, size_t *);
+};
+
 union ApiTable {
     api_abi_base base;
     api_abi_v1 v1;
     api_abi_v2 v2;
     api_abi_v4 v4;
+    api_abi_v6 v6;
 };
 
 struct ZygiskModule {
     void onLoad(void *env) { entry.fn(&api, env); }
+    void onZygoteLoad(JNIEnv *env);
 
     void preAppSpecialize(AppSpecializeArgs_v5 *args) const;
     void postAppSpecialize(const AppSpecializeArgs_v5 *args) const;
@@ -206,11 +222,17 @@ struct ZygiskModule {
     bool valid() const;
     int connectCompanion() const;
     int getModuleDir() const;
+    const void *getConfig(size_t *size) const;
+    /// Maps the config blob the daemon sent along with the module; `fd` may be closed afterwards.
+    void attachConfig(int fd);
+    void releaseConfig();
     void setOption(zygisk::Option opt);
     static uint32_t getFlags();
     bool tryUnload() const;
     void clearApi() { memset(&api, 0, sizeof(api)); }
     int getId() const { return id; }
+    void *getHandle() const { return handle; }
+    void *getEntry() const { return entry.ptr; }
 
     ZygiskModule(int id, void *handle, void *entry);
 
@@ -219,6 +241,10 @@ struct ZygiskModule {
 private:
     const int id;
     bool unload = false;
+    // While set, registering only records the module ABI, so that its entry skips onLoad.
+    bool in_zygote = false;
+    const void *config = nullptr;
+    size_t config_size = 0;
 
     void *const handle;
     union {
@@ -231,6 +257,7 @@ private:
     union {
         long *api_version;
         module_abi_v1 *v1;
+        module_abi_v6 *v6;
     } mod;
 };
 
@@ -252,6 +279,8 @@ enum : uint32_t {
     void name##_post();
 
 struct ZygiskContext {
+    // Backs every container below; declared first so that it is rewound before they allocate.
+    std::pmr::memory_resource *arena;
     JNIEnv *env;
     union {
         void *ptr;
@@ -260,33 +289,55 @@ struct ZygiskContext {
     } args;
 
     const char *process;
-    std::list<ZygiskModule> modules;
+    std::pmr::list<ZygiskModule> modules;
 
     pid_t pid;
     uint32_t flags;
     uint32_t info_flags;
-    std::vector<bool> allowed_fds;
-    std::vector<int> exempted_fds;
+    // Connection of a flag query zygote sent right before forking, answered while it forks.
+    int flags_query;
+    struct timespec flags_query_sent;
+    std::pmr::vector<bool> allowed_fds;
+    std::pmr::vector<int> exempted_fds;
+
+    /**
+     * @brief A compiled path regex with a literal prefilter.
+     *
+     * Most patterns registered by modules are a library name, e.g. `.*\/libfoo\.so$`. The longest
+     * literal that every match has to contain is extracted once, so that most paths are rejected
+     * by a substring (or suffix) comparison before `regexec` runs.
+     */
+    struct PathRegex {
+        regex_t regex;
+        std::pmr::string literal;
+        bool literal_is_suffix = false;
 
+        explicit PathRegex(std::pmr::memory_resource *arena) : literal(arena) {}
+        bool compile(const char *pattern);
+        bool matches(const std::string &path) const;
+    };
+
+    // Strings are allocated from the arena, like the vectors holding them.
     struct RegisterInfo {
-        regex_t regex;
-        std::string symbol;
+        PathRegex regex;
+        std::pmr::string symbol;
         void *callback;
         void **backup;
     };
 
     struct IgnoreInfo {
-        regex_t regex;
-        std::string symbol;
+        PathRegex regex;
+        std::pmr::string symbol;
     };
 
     pthread_mutex_t hook_info_lock;
-    std::vector<RegisterInfo> register_info;
-    std::vector<IgnoreInfo> ignore_info;
+    std::pmr::vector<RegisterInfo> register_info;
+    std::pmr::vector<IgnoreInfo> ignore_info;
 
     ZygiskContext(JNIEnv *env, void *args);
     ~ZygiskContext();
 
+    void load_zygote_modules();
     void run_modules_pre();
     void run_modules_post();
     DCL_PRE_POST(fork)
@@ -296,6 +347,7 @@ struct ZygiskContext {
     DCL_PRE_POST(nativeSpecializeAppProcess)
     DCL_PRE_POST(nativeForkSystemServer)
 
+    uid_t resolve_app_uid() const;
     void sanitize_fds();
     bool exempt_fd(int fd);
     bool can_exempt_fd() const;
@@ -321,6 +373,7 @@ struct HookContext {
     // std::array<JNINativeMethod> zygote_methods
     void *start_addr = nullptr;
     size_t block_size = 0;
+    uint32_t kernel_caps = 0;
     bool should_spoof_maps = false;
     bool should_unmap = false;
     bool skip_hooking_unloader = false;
@@ -329,9 +382,20 @@ struct HookContext {
     jmethodID member_getModifiers = nullptr;
     std::vector<lsplt::MapInfo> cached_map_infos = {};
     std::vector<std::tuple<dev_t, ino_t, const char *, void **>> plt_backup;
+    // Libraries targeted by hooks registered since the last commit.
+    std::vector<std::pair<dev_t, ino_t>> pending_plt_targets;
+    PltHookTable plt_hooks;
+    SpecializationArena specialization_arena;
+    // Modules loaded into zygote itself, inherited by every child; see load_zygote_modules().
+    std::list<ZygiskModule> zygote_modules;
+    bool zygote_modules_loaded = false;
     std::vector<mount_info> zygote_traces;
 
-    HookContext(void *start_addr, size_t block_size);
+    HookContext(void *start_addr, size_t block_size, uint32_t kernel_caps);
+
+    bool register_plt_hook(dev_t dev, ino_t inode, const char *symbol, void *callback,
+                           void **backup);
+    bool commit_plt_hooks(const char *reason);
 
     void hook_plt();
     void hook_unloader();
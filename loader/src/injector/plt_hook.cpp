@@ -0,0 +1,134 @@
+#include "plt_hook.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "elf_parser.hpp"
+#include "logging.hpp"
+
+bool PltHookTable::Register(dev_t dev, ino_t inode, std::string_view symbol, void *callback,
+                            void **backup) {
+    if (inode == 0 || symbol.empty() || callback == nullptr) return false;
+    pending_.push_back({dev, inode, std::string(symbol), callback, backup});
+    return true;
+}
+
+bool PltHookTable::Commit(const std::vector<lsplt::MapInfo> &maps) {
+    if (pending_.empty()) return true;
+
+    // Locate the ELF header of every instance of the target libraries with a single pass over the
+    // maps.
+    std::map<std::pair<dev_t, ino_t>, std::vector<uintptr_t>> headers;
+    for (auto &hook : pending_) headers.try_emplace(std::make_pair(hook.dev, hook.inode));
+    for (auto &map : maps) {
+        if (map.offset != 0 || !(map.perms & PROT_READ)) continue;
+        auto it = headers.find({map.dev, map.inode});
+        if (it != headers.end()) it->second.push_back(map.start);
+    }
+
+    bool ok = true;
+    // The value each hooked symbol's slots will hold, so that hooks chained within a single
+    // commit see each other.
+    std::unordered_map<const std::vector<uintptr_t> *, void *> staged;
+    for (auto &hook : pending_) {
+        bool found = false;
+        bool backed_up = false;
+        for (uintptr_t header : headers[{hook.dev, hook.inode}]) {
+            auto *library = findLibrary(hook.dev, hook.inode, header);
+            if (library == nullptr) continue;
+            found = true;
+            auto slots = library->slots.find(hook.symbol);
+            if (slots == library->slots.end()) continue;
+
+            auto value = staged.find(&slots->second);
+            void *current = value != staged.end()
+                                ? value->second
+                                : *reinterpret_cast<void **>(slots->second.front());
+            if (hook.backup != nullptr && !backed_up) {
+                *hook.backup = current;
+                backed_up = true;
+            }
+            staged[&slots->second] = hook.callback;
+        }
+        if (!found) {
+            LOGW("cannot hook %s: library [%lu, %lu] is not mapped", hook.symbol.c_str(),
+                 (unsigned long) hook.dev, (unsigned long) hook.inode);
+            ok = false;
+        } else if (!backed_up) {
+            LOGV("symbol %s is not imported by library [%lu, %lu]", hook.symbol.c_str(),
+                 (unsigned long) hook.dev, (unsigned long) hook.inode);
+        }
+    }
+    pending_.clear();
+
+    std::vector<SlotWrite> writes;
+    for (auto &[slots, value] : staged) {
+        for (uintptr_t slot : *slots) writes.push_back({slot, value});
+    }
+    return writeSlots(writes, maps) && ok;
+}
+
+PltHookTable::Library *PltHookTable::findLibrary(dev_t dev, ino_t inode, uintptr_t header) {
+    auto &library = libraries_[header];
+    if (library.dev == dev && library.inode == inode) return &library;
+
+    // First hook into this mapping of the library: index its relocations once.
+    library = {};
+    ElfParser::DynamicImage image;
+    if (!image.parse(header)) {
+        libraries_.erase(header);
+        return nullptr;
+    }
+    library.dev = dev;
+    library.inode = inode;
+    image.forEachSymbolSlot(
+        [&library](std::string_view name, uintptr_t slot) { library.slots[name].push_back(slot); });
+    return &library;
+}
+
+/**
+ * @brief Performs the slot writes, making every mapping involved writable only once.
+ *
+ * GOT slots live in RELRO, which is read-only after relocation. Writes are sorted so that all
+ * those falling into one mapping share a single pair of `mprotect` calls.
+ */
+bool PltHookTable::writeSlots(std::vector<SlotWrite> &writes,
+                              const std::vector<lsplt::MapInfo> &maps) {
+    static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+
+    std::sort(writes.begin(), writes.end(),
+              [](const SlotWrite &a, const SlotWrite &b) { return a.slot < b.slot; });
+    bool ok = true;
+    for (size_t i = 0; i < writes.size();) {
+        uintptr_t slot = writes[i].slot;
+        auto map = std::find_if(maps.begin(), maps.end(), [slot](const lsplt::MapInfo &m) {
+            return m.start <= slot && slot + sizeof(void *) <= m.end;
+        });
+        if (map == maps.end()) {
+            LOGE("GOT slot %p is not mapped", (void *) slot);
+            ok = false;
+            ++i;
+            continue;
+        }
+        size_t j = i;
+        while (j < writes.size() && writes[j].slot + sizeof(void *) <= map->end) ++j;
+
+        uintptr_t begin = slot & ~(page_size - 1);
+        uintptr_t end = (writes[j - 1].slot + sizeof(void *) + page_size - 1) & ~(page_size - 1);
+        bool writable = map->perms & PROT_WRITE;
+        if (!writable && mprotect((void *) begin, end - begin, map->perms | PROT_WRITE) == -1) {
+            PLOGE("make GOT [%p, %p] writable", (void *) begin, (void *) end);
+            ok = false;
+            i = j;
+            continue;
+        }
+        for (size_t k = i; k < j; ++k) {
+            *reinterpret_cast<void **>(writes[k].slot) = writes[k].value;
+        }
+        if (!writable) mprotect((void *) begin, end - begin, map->perms);
+        i = j;
+    }
+    return ok;
+}
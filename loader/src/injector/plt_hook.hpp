@@ -0,0 +1,68 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <lsplt.hpp>
+
+/**
+ * @brief An in-process PLT/GOT hook backend.
+ *
+ * Hooks are registered by (library, symbol) and applied by `Commit()`, with the same semantics as
+ * `lsplt`: `backup` receives the value the slots held before, and registering the original
+ * function again removes the hook.
+ *
+ * A library mapped more than once, e.g. loaded into several linker namespaces, is hooked in every
+ * instance. The relocation tables of each instance are parsed from its mapped dynamic section the
+ * first time it is hooked; the result is an index from symbol name to GOT slots that is kept for
+ * the lifetime of the mapping, so later commits look slots up directly. All slot writes of a
+ * commit are sorted and every mapping they fall into is made writable once.
+ */
+class PltHookTable {
+public:
+    /// Queues a hook for the next `Commit()`. Returns false for an invalid request.
+    bool Register(dev_t dev, ino_t inode, std::string_view symbol, void *callback, void **backup);
+
+    /**
+     * @brief Applies every queued hook.
+     * @param maps The current memory maps, used to locate the target libraries.
+     * @return False if any queued hook could not be applied.
+     */
+    bool Commit(const std::vector<lsplt::MapInfo> &maps);
+
+private:
+    struct Library {
+        // The file mapped at the header; another file there means the address was reused.
+        dev_t dev = 0;
+        ino_t inode = 0;
+        // Slots importing each symbol. The names point into the library's mapped string table.
+        std::unordered_map<std::string_view, std::vector<uintptr_t>> slots;
+    };
+
+    struct Pending {
+        dev_t dev;
+        ino_t inode;
+        std::string symbol;
+        void *callback;
+        void **backup;
+    };
+
+    struct SlotWrite {
+        uintptr_t slot;
+        void *value;
+    };
+
+    Library *findLibrary(dev_t dev, ino_t inode, uintptr_t header);
+    static bool writeSlots(std::vector<SlotWrite> &writes, const std::vector<lsplt::MapInfo> &maps);
+
+    // Indexed instances, keyed by the address of their ELF header.
+    std::unordered_map<uintptr_t, Library> libraries_;
+    std::vector<Pending> pending_;
+};
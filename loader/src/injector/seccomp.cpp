@@ -13,6 +13,7 @@
 #include <fstream>
 #include <string>
 
+#include "kernel_caps.hpp"
 #include "logging.hpp"
 #include "zygisk.hpp"
 
@@ -31,10 +32,18 @@
  * - If the field does not exist, it implies an older kernel where this seccomp
  *   method is probably necessary and potentially invisible.
  *
+ * The monitor probes this once at boot and passes the result down as part of `kernel_caps`; the
+ * procfs check is only a fallback for a bitmap that was never filled in.
+ *
+ * @param caps The `kernel_caps` bitmap handed to `entry()` by the tracer.
  * @return True if the seccomp method should be skipped, false if it should be used.
  */
 
-static bool should_skip_seccomp_injection() {
+static bool should_skip_seccomp_injection(uint32_t caps) {
+    if (caps & kernel_caps::PROBED) {
+        return caps & kernel_caps::SECCOMP_FILTER_COUNT;
+    }
+
     // Use std::ifstream for automatic resource management (RAII).
     std::ifstream status_file("/proc/self/status");
     if (!status_file.is_open()) {
@@ -55,27 +64,21 @@ static bool should_skip_seccomp_injection() {
     return false;
 }
 
-void send_seccomp_event_if_needed() {
-    if (should_skip_seccomp_injection()) {
+void send_seccomp_event_if_needed(uint32_t caps) {
+    if (should_skip_seccomp_injection(caps)) {
         return;
     }
 
     // Use std::array for type-safe, fixed-size arrays.
     std::array<uint32_t, 4> args{};
 
-    // Read random bytes to create a unique syscall signature.
-    {
-        std::ifstream random_file("/dev/urandom", std::ios::binary);
-        if (!random_file.is_open()) {
-            PLOGE("seccomp: open(/dev/urandom)");
-            return;
-        }
-        random_file.read(reinterpret_cast<char *>(args.data()), args.size() * sizeof(uint32_t));
-        if (!random_file) {
-            PLOGE("seccomp: read(random_file)");
-            return;
-        }
-    }  // random_file is automatically closed here by its destructor.
+    // Read random bytes to create a unique syscall signature. getrandom(2) avoids opening
+    // /dev/urandom inside zygote.
+    constexpr size_t args_size = args.size() * sizeof(uint32_t);
+    if (syscall(__NR_getrandom, args.data(), args_size, 0) != static_cast<long>(args_size)) {
+        PLOGE("seccomp: getrandom");
+        return;
+    }
 
     // Modify a bit to ensure the signature is highly unlikely to occur naturally.
     args[0] |= 0x10000;
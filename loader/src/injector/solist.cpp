@@ -167,37 +167,44 @@ bool findHeuristicOffsets(std::string linker_name, SoInfoWrapper *vdso) {
     return size_field_found && next_field_found && constructor_called_field_found;
 }
 
+bool ensureInitialized() { return solinker != nullptr || initialize(); }
+
 bool dropSoPath(const char *target_path, bool unload) {
-    bool path_found = false;
-    if (solinker == nullptr && !initialize()) {
+    if (!ensureInitialized()) {
         LOGE("failed to initialize solist before dropping paths");
-        return path_found;
+        return false;
     }
-    for (auto *iter = solinker; iter; iter = iter->getNext()) {
-        if (iter->getPath() && strstr(iter->getPath(), target_path)) {
-            Linker::ProtectedDataGuard guard;
+    // The guard unprotects the linker's data for as long as it lives, so one is enough for the
+    // whole walk. It is only taken once something actually needs to be dropped.
+    std::optional<ProtectedDataGuard> guard;
+    bool path_found = false;
+    for (auto *iter = solinker; iter;) {
+        // Releasing a record may clear it, so read the link first.
+        auto *next = iter->getNext();
+        const char *path = iter->getPath();
+        if (path && strstr(path, target_path) && iter->getSize() > 0) {
+            if (!guard) guard.emplace();
             auto size = iter->getSize();
-            LOGV("dropping solist record for %s [size %zu, constructor_called: %d]",
-                 iter->getPath(), size, iter->getConstructorCalled());
-            if (size > 0) {
-                iter->setSize(0);
-                if (unload) {
-                    iter->setConstructorCalled(false);
-                    SoInfoWrapper::soinfo_unload(iter);
-                    iter->setConstructorCalled(true);
-                } else {
-                    SoInfoWrapper::soinfo_free(iter);
-                    iter->setSize(size);
-                }
-                path_found = true;
+            LOGV("dropping solist record for %s [size %zu, constructor_called: %d]", path, size,
+                 iter->getConstructorCalled());
+            iter->setSize(0);
+            if (unload) {
+                iter->setConstructorCalled(false);
+                SoInfoWrapper::soinfo_unload(iter);
+                iter->setConstructorCalled(true);
+            } else {
+                SoInfoWrapper::soinfo_free(iter);
+                iter->setSize(size);
             }
+            path_found = true;
         }
+        iter = next;
     }
     return path_found;
 }
 
 void resetCounters(size_t load, size_t unload) {
-    if (solinker == nullptr && !initialize()) {
+    if (!ensureInitialized()) {
         LOGE("failed to initialize solist before resetting counters");
         return;
     }
@@ -18,19 +18,23 @@ struct mount_info {
     std::string raw_info;
 };
 
-void hook_entry(void *start_addr, size_t block_size);
+void hook_entry(void *start_addr, size_t block_size, uint32_t kernel_caps);
 
 void hookJniNativeMethods(JNIEnv *env, const char *clz, JNINativeMethod *methods, int numMethods);
 
+void prepare_cleanup_plan();
+
 void clean_libc_trace();
 
 void clean_linker_trace(const char *path, size_t loaded_modules, size_t unloaded_modules,
                         bool unload_soinfo);
 
-void spoof_virtual_maps(const char *path, bool clear_write_permission);
+// Maps overlapping [skip_start, skip_start + skip_size) are left alone, e.g. our own image.
+void spoof_virtual_maps(const char *path, bool clear_write_permission, const void *skip_start,
+                        size_t skip_size);
 
 void spoof_zygote_fossil(char *search_from, char *search_to, const char *anchor);
 
-void send_seccomp_event_if_needed();
+void send_seccomp_event_if_needed(uint32_t caps);
 
 std::vector<mount_info> check_zygote_traces(uint32_t info_flags);
@@ -0,0 +1,165 @@
+#include "crash_governor.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+
+#include "logging.hpp"
+
+/// The upper half (rounded up) of the set bits of `mask`.
+static uint32_t upper_half(uint32_t mask) {
+    int keep = std::popcount(mask) / 2;
+    for (; keep > 0; --keep) mask &= mask - 1;
+    return mask;
+}
+
+static std::string hex(uint32_t value) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "0x%x", value);
+    return buf;
+}
+
+uint32_t CrashGovernor::all_modules() const {
+    if (module_count_ <= 0) return 0;
+    return module_count_ >= 32 ? UINT32_MAX : (1u << module_count_) - 1;
+}
+
+void CrashGovernor::back_off(time_t now) {
+    backoff_level_ = std::min(backoff_level_ + 1, BACKOFF_MAX_LEVEL);
+    retry_at_ = now + (static_cast<time_t>(BACKOFF_BASE_SECONDS) << (backoff_level_ - 1));
+}
+
+void CrashGovernor::evaluate(const Start &previous) {
+    bool crashed = previous.lifetime < CRASH_WINDOW_SECONDS;
+    time_t now = previous.time + previous.lifetime;
+
+    if (suspects_ == 0) {
+        if (!crashed) {
+            consecutive_crashes_ = 0;
+            // Healthy with every module loaded: the next failure starts from a short backoff.
+            if (previous.disabled == 0) backoff_level_ = 0;
+            return;
+        }
+        if (++consecutive_crashes_ < CRASH_LOOP_RETRY_COUNT) return;
+        consecutive_crashes_ = 0;
+        suspects_ = all_modules();
+        LOGW("zygote%s crashed %d times in a row, bisecting modules %s", abi_name_,
+             CRASH_LOOP_RETRY_COUNT, hex(suspects_).c_str());
+    } else if (crashed) {
+        // The culprit is among the suspects that were loaded.
+        suspects_ &= ~previous.disabled;
+    } else {
+        // Zygote stayed up without the disabled suspects, so the culprit is one of them.
+        suspects_ &= previous.disabled;
+        if (std::popcount(suspects_) == 1) {
+            LOGW("zygote%s: module #%d crashes zygote, keeping it disabled", abi_name_,
+                 std::countr_zero(suspects_));
+            disabled_ = suspects_;
+            suspects_ = 0;
+            back_off(now);
+            return;
+        }
+    }
+
+    if (suspects_ == 0) {
+        LOGW("zygote%s keeps crashing without modules, pausing injection", abi_name_);
+        paused_ = true;
+        disabled_ = 0;
+        back_off(now);
+        return;
+    }
+    disabled_ = upper_half(suspects_);
+}
+
+CrashGovernor::Decision CrashGovernor::OnZygoteStart(time_t now) {
+    if (starts_ > 0) {
+        Start &previous = history_[(starts_ - 1) % HISTORY_SIZE];
+        previous.lifetime = now - previous.time;
+        // A zygote we did not inject tells nothing about the modules.
+        if (previous.injected && !previous.evaluated) evaluate(previous);
+    }
+    expire_backoff(now);
+
+    history_[starts_++ % HISTORY_SIZE] = {now, -1, !paused_, false, disabled_};
+    return {!paused_, disabled_};
+}
+
+void CrashGovernor::OnTimer(time_t now) {
+    if (starts_ > 0) {
+        Start &current = history_[(starts_ - 1) % HISTORY_SIZE];
+        if (current.lifetime < 0 && current.injected && !current.evaluated &&
+            now - current.time >= CRASH_WINDOW_SECONDS) {
+            // Judge it as if it stopped now; by then it no longer counts as a crash.
+            Start running = current;
+            running.lifetime = now - current.time;
+            current.evaluated = true;
+            evaluate(running);
+        }
+    }
+    expire_backoff(now);
+}
+
+time_t CrashGovernor::NextDeadline() const {
+    time_t deadline = 0;
+    if (starts_ > 0) {
+        const Start &current = history_[(starts_ - 1) % HISTORY_SIZE];
+        if (current.lifetime < 0 && current.injected && !current.evaluated) {
+            deadline = current.time + CRASH_WINDOW_SECONDS;
+        }
+    }
+    if (suspects_ == 0 && (paused_ || disabled_ != 0)) {
+        deadline = deadline == 0 ? retry_at_ : std::min(deadline, retry_at_);
+    }
+    return deadline;
+}
+
+void CrashGovernor::expire_backoff(time_t now) {
+    if (suspects_ == 0 && (paused_ || disabled_ != 0) && now >= retry_at_) {
+        LOGI("zygote%s: backoff expired, retrying with every module", abi_name_);
+        paused_ = false;
+        disabled_ = 0;
+    }
+}
+
+void CrashGovernor::Reset() {
+    history_ = {};
+    starts_ = 0;
+    consecutive_crashes_ = 0;
+    backoff_level_ = 0;
+    retry_at_ = 0;
+    paused_ = false;
+    suspects_ = 0;
+    disabled_ = 0;
+}
+
+std::string CrashGovernor::Describe(time_t now) const {
+    std::string retry = std::to_string(std::max<time_t>(retry_at_ - now, 0)) + "s";
+    if (paused_) return "injection paused after repeated crashes, retry in " + retry;
+    if (suspects_ != 0) {
+        return "bisecting crashing modules, " + std::to_string(std::popcount(disabled_)) +
+               " disabled";
+    }
+    if (disabled_ != 0) {
+        return "modules " + hex(disabled_) + " disabled after crashes, retry in " + retry;
+    }
+    return {};
+}
+
+void CrashGovernor::WriteStats(
+    time_t now, const std::function<void(std::string_view, std::string_view)> &put) const {
+    put("governor.consecutive_crashes", std::to_string(consecutive_crashes_));
+    put("governor.backoff_level", std::to_string(backoff_level_));
+    put("governor.retry_in_s", std::to_string(std::max<time_t>(retry_at_ - now, 0)));
+    put("governor.paused", paused_ ? "1" : "0");
+    put("governor.suspects", hex(suspects_));
+    put("governor.disabled_modules", hex(disabled_));
+    // Most recent start first: "<lifetime or running>,<injected>,<disabled modules>".
+    size_t count = std::min(starts_, HISTORY_SIZE);
+    for (size_t i = 0; i < count; ++i) {
+        const Start &start = history_[(starts_ - 1 - i) % HISTORY_SIZE];
+        std::string value = start.lifetime < 0 ? "running" : std::to_string(start.lifetime) + "s";
+        value += start.injected ? ",injected," : ",skipped,";
+        value += hex(start.disabled);
+        put("governor.history." + std::to_string(i), value);
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <time.h>
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Decides whether, and with which modules, each start of one zygote is injected.
+ *
+ * An injected zygote that dies within `CRASH_WINDOW_SECONDS` counts as a crash. After
+ * `CRASH_LOOP_RETRY_COUNT` consecutive crashes the governor bisects the modules: half of the
+ * suspects are disabled for the next start, and whether that zygote crashes again tells which
+ * half the culprit is in. Each further step costs a single crash. If zygote still crashes once
+ * every suspect is disabled, the modules are not at fault and injection is paused altogether.
+ *
+ * Nothing is permanent. Once the governor settles on disabling a module or pausing injection, it
+ * schedules a retry with every module after an exponentially growing delay. A zygote that stays
+ * up with every module loaded resets the backoff, so transient failures heal without a reboot.
+ *
+ * A running zygote is judged as soon as it outlives the crash window, and the backoff expires on
+ * time, when the owner calls `OnTimer()` at `NextDeadline()`. Modules held back from a running
+ * zygote cannot be loaded into it; the verdict applies from its next start.
+ *
+ * Modules are identified by their index in the daemon's load order; only the first 32 can be
+ * disabled.
+ */
+class CrashGovernor {
+public:
+    static constexpr int CRASH_LOOP_RETRY_COUNT = 3;
+    static constexpr int CRASH_WINDOW_SECONDS = 30;
+    static constexpr int BACKOFF_BASE_SECONDS = 60;
+    static constexpr int BACKOFF_MAX_LEVEL = 8;
+    static constexpr size_t HISTORY_SIZE = 8;
+
+    struct Decision {
+        bool inject;
+        // Bit i set: the daemon must not load module i.
+        uint32_t disabled_modules;
+    };
+
+    explicit CrashGovernor(const char *abi_name) : abi_name_(abi_name) {}
+
+    /// Records a zygote start at `now` (seconds of CLOCK_MONOTONIC) and decides how to treat it.
+    Decision OnZygoteStart(time_t now);
+    /// Judges a zygote that outlived the crash window and expires the backoff.
+    void OnTimer(time_t now);
+    /// When `OnTimer()` next has something to do, or 0 if never.
+    time_t NextDeadline() const;
+    /// Sets the number of modules the daemon has loaded, the range of the bisection.
+    void SetModuleCount(int count) { module_count_ = count; }
+    /// Forgets every crash, e.g. when the user restarts tracing by hand.
+    void Reset();
+
+    /// A one-line summary for module.prop; empty while nothing is held back.
+    std::string Describe(time_t now) const;
+    void WriteStats(time_t now,
+                    const std::function<void(std::string_view, std::string_view)> &put) const;
+
+private:
+    struct Start {
+        time_t time = 0;
+        // Seconds the zygote stayed up; -1 while it is still running.
+        time_t lifetime = -1;
+        bool injected = false;
+        // Judged already, by `OnTimer()` while it was running.
+        bool evaluated = false;
+        uint32_t disabled = 0;
+    };
+
+    void evaluate(const Start &previous);
+    void back_off(time_t now);
+    void expire_backoff(time_t now);
+    uint32_t all_modules() const;
+
+    const char *const abi_name_;
+    std::array<Start, HISTORY_SIZE> history_{};
+    size_t starts_ = 0;
+    int module_count_ = -1;
+
+    int consecutive_crashes_ = 0;
+    int backoff_level_ = 0;
+    time_t retry_at_ = 0;
+    bool paused_ = false;
+    // Modules that may crash zygote, while bisecting.
+    uint32_t suspects_ = 0;
+    uint32_t disabled_ = 0;
+};
@@ -0,0 +1,476 @@
+#include "elf_loader.hpp"
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+
+#include "logging.hpp"
+
+// Relocation types shared by every ABI, named after their counterparts in bionic's linker.
+#if defined(__aarch64__)
+#define R_GENERIC_RELATIVE R_AARCH64_RELATIVE
+#define R_GENERIC_GLOB_DAT R_AARCH64_GLOB_DAT
+#define R_GENERIC_JUMP_SLOT R_AARCH64_JUMP_SLOT
+#define R_GENERIC_ABSOLUTE R_AARCH64_ABS64
+#elif defined(__x86_64__)
+#define R_GENERIC_RELATIVE R_X86_64_RELATIVE
+#define R_GENERIC_GLOB_DAT R_X86_64_GLOB_DAT
+#define R_GENERIC_JUMP_SLOT R_X86_64_JUMP_SLOT
+#define R_GENERIC_ABSOLUTE R_X86_64_64
+#elif defined(__arm__)
+#define R_GENERIC_RELATIVE R_ARM_RELATIVE
+#define R_GENERIC_GLOB_DAT R_ARM_GLOB_DAT
+#define R_GENERIC_JUMP_SLOT R_ARM_JUMP_SLOT
+#define R_GENERIC_ABSOLUTE R_ARM_ABS32
+#elif defined(__i386__)
+#define R_GENERIC_RELATIVE R_386_RELATIVE
+#define R_GENERIC_GLOB_DAT R_386_GLOB_DAT
+#define R_GENERIC_JUMP_SLOT R_386_JMP_SLOT
+#define R_GENERIC_ABSOLUTE R_386_32
+#endif
+
+// LP64 ABIs use RELA, the 32-bit ones use REL with implicit addends.
+#if defined(__LP64__)
+#define USE_RELA 1
+using Reloc = ElfW(Rela);
+#define RELOC_TYPE(info) ELF64_R_TYPE(info)
+#define RELOC_SYM(info) ELF64_R_SYM(info)
+#else
+using Reloc = ElfW(Rel);
+#define RELOC_TYPE(info) ELF32_R_TYPE(info)
+#define RELOC_SYM(info) ELF32_R_SYM(info)
+#endif
+
+#ifndef DT_RELR
+#define DT_RELRSZ 35
+#define DT_RELR 36
+#endif
+#ifndef DT_ANDROID_REL
+#define DT_ANDROID_REL 0x6000000f
+#define DT_ANDROID_RELA 0x60000011
+#endif
+
+// Distinct from the modules' "jit-cache-zygisk": maps spoofing must not swap out our own code.
+static constexpr char MEMFD_NAME[] = "zygisk-image";
+
+static int segment_prot(ElfW(Word) flags) {
+    return ((flags & PF_R) ? PROT_READ : 0) | ((flags & PF_W) ? PROT_WRITE : 0) |
+           ((flags & PF_X) ? PROT_EXEC : 0);
+}
+
+/**
+ * @brief Reads the library file and lays its PT_LOAD segments out in virtual address order.
+ */
+bool RemoteElfLoader::Prepare(const char *path, const char *entry_symbol,
+                              const std::vector<MapInfo> &local_map,
+                              const std::vector<MapInfo> &remote_map) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        PLOGE("open %s", path);
+        return false;
+    }
+    struct stat st{};
+    std::vector<uint8_t> file;
+    if (fstat(fd, &st) == 0) {
+        file.resize(st.st_size);
+        if (pread(fd, file.data(), file.size(), 0) != st.st_size) file.clear();
+    }
+    close(fd);
+    if (file.size() < sizeof(ElfW(Ehdr))) {
+        LOGE("failed to read %s", path);
+        return false;
+    }
+
+    auto *ehdr = reinterpret_cast<const ElfW(Ehdr) *>(file.data());
+    constexpr int ELF_CLASS = sizeof(void *) == 8 ? ELFCLASS64 : ELFCLASS32;
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELF_CLASS ||
+        ehdr->e_type != ET_DYN ||
+        ehdr->e_phoff + ehdr->e_phnum * sizeof(ElfW(Phdr)) > file.size()) {
+        LOGE("%s is not a valid shared object for this ABI", path);
+        return false;
+    }
+    auto *phdr = reinterpret_cast<const ElfW(Phdr) *>(file.data() + ehdr->e_phoff);
+
+    const size_t page_size = getpagesize();
+    uintptr_t max_vaddr = 0;
+    min_vaddr_ = UINTPTR_MAX;
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdr[i].p_type == PT_TLS) {
+            LOGW("%s uses TLS, which reflective loading does not support", path);
+            return false;
+        }
+        if (phdr[i].p_type != PT_LOAD) continue;
+        min_vaddr_ = std::min<uintptr_t>(min_vaddr_, phdr[i].p_vaddr & ~(page_size - 1));
+        max_vaddr = std::max<uintptr_t>(max_vaddr, phdr[i].p_vaddr + phdr[i].p_memsz);
+    }
+    if (min_vaddr_ == UINTPTR_MAX) return false;
+    max_vaddr = (max_vaddr + page_size - 1) & ~(page_size - 1);
+
+    // Everything past p_filesz (.bss) stays zero-filled.
+    image_.assign(max_vaddr - min_vaddr_, 0);
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        const auto &ph = phdr[i];
+        if (ph.p_type == PT_LOAD) {
+            if (ph.p_offset + ph.p_filesz > file.size()) return false;
+            memcpy(&at<uint8_t>(ph.p_vaddr), file.data() + ph.p_offset, ph.p_filesz);
+            uintptr_t start = ph.p_vaddr & ~(page_size - 1);
+            uintptr_t end = (ph.p_vaddr + ph.p_memsz + page_size - 1) & ~(page_size - 1);
+            segments_.push_back({start - min_vaddr_, end - start, segment_prot(ph.p_flags)});
+        } else if (ph.p_type == PT_GNU_RELRO) {
+            relro_start_ = (ph.p_vaddr & ~(page_size - 1)) - min_vaddr_;
+            uintptr_t end = (ph.p_vaddr + ph.p_memsz + page_size - 1) & ~(page_size - 1);
+            relro_size_ = end - min_vaddr_ - relro_start_;
+        }
+    }
+
+    // The dynamic symbol table is sized by its section header; DT_HASH is the fallback.
+    if (ehdr->e_shoff + ehdr->e_shnum * sizeof(ElfW(Shdr)) <= file.size()) {
+        auto *shdr = reinterpret_cast<const ElfW(Shdr) *>(file.data() + ehdr->e_shoff);
+        for (int i = 0; i < ehdr->e_shnum; i++) {
+            if (shdr[i].sh_type == SHT_DYNSYM && shdr[i].sh_entsize != 0) {
+                dynsym_count_ = shdr[i].sh_size / shdr[i].sh_entsize;
+            }
+        }
+    }
+
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdr[i].p_type == PT_DYNAMIC && !parseDynamic(phdr[i].p_vaddr)) return false;
+    }
+    if (dynsym_ == nullptr || dynstr_ == nullptr || dynsym_count_ == 0) {
+        LOGE("%s has no dynamic symbol table", path);
+        return false;
+    }
+
+    for (size_t i = 0; i < dynsym_count_; i++) {
+        if (dynsym_[i].st_shndx != SHN_UNDEF &&
+            strcmp(dynstr_ + dynsym_[i].st_name, entry_symbol) == 0) {
+            entry_ = dynsym_[i].st_value - min_vaddr_;
+            break;
+        }
+    }
+    if (entry_ == 0) {
+        LOGE("%s does not export %s", path, entry_symbol);
+        return false;
+    }
+
+    return resolveImports(remote_map) && resolveLibc(local_map, remote_map);
+}
+
+/**
+ * @brief Collects the dynamic tags the loader needs and rejects unsupported relocation formats.
+ */
+bool RemoteElfLoader::parseDynamic(uintptr_t dynamic_vaddr) {
+    std::vector<uintptr_t> needed_offsets;
+    for (auto *dyn = &at<ElfW(Dyn)>(dynamic_vaddr); dyn->d_tag != DT_NULL; dyn++) {
+        switch (dyn->d_tag) {
+        case DT_SYMTAB:
+            dynsym_ = &at<ElfW(Sym)>(dyn->d_un.d_ptr);
+            break;
+        case DT_STRTAB:
+            dynstr_ = &at<char>(dyn->d_un.d_ptr);
+            break;
+        case DT_NEEDED:
+            needed_offsets.push_back(dyn->d_un.d_val);
+            break;
+        case DT_HASH:
+            // nchain equals the number of symbols.
+            if (dynsym_count_ == 0) dynsym_count_ = (&at<uint32_t>(dyn->d_un.d_ptr))[1];
+            break;
+#if defined(USE_RELA)
+        case DT_RELA:
+            rel_ = dyn->d_un.d_ptr;
+            break;
+        case DT_RELASZ:
+            rel_size_ = dyn->d_un.d_val;
+            break;
+        case DT_REL:
+        case DT_RELSZ:
+#else
+        case DT_REL:
+            rel_ = dyn->d_un.d_ptr;
+            break;
+        case DT_RELSZ:
+            rel_size_ = dyn->d_un.d_val;
+            break;
+        case DT_RELA:
+        case DT_RELASZ:
+#endif
+        case DT_ANDROID_REL:
+        case DT_ANDROID_RELA:
+            LOGW("unsupported relocation table (tag 0x%" PRIxPTR ")", (uintptr_t) dyn->d_tag);
+            return false;
+        case DT_JMPREL:
+            jmprel_ = dyn->d_un.d_ptr;
+            break;
+        case DT_PLTRELSZ:
+            jmprel_size_ = dyn->d_un.d_val;
+            break;
+        case DT_RELR:
+            relr_ = dyn->d_un.d_ptr;
+            break;
+        case DT_RELRSZ:
+            relr_size_ = dyn->d_un.d_val;
+            break;
+        case DT_INIT:
+            init_ = dyn->d_un.d_ptr;
+            break;
+        case DT_INIT_ARRAY:
+            init_array_ = dyn->d_un.d_ptr;
+            break;
+        case DT_INIT_ARRAYSZ:
+            init_array_size_ = dyn->d_un.d_val;
+            break;
+        default:
+            break;
+        }
+    }
+    for (auto offset : needed_offsets) needed_.push_back(dynstr_ + offset);
+    return true;
+}
+
+/**
+ * @brief Resolves every symbol referenced by a relocation to its value in the tracee.
+ *
+ * A symbol is looked up in the library's DT_NEEDED dependencies, in order, through our own copy
+ * of them. `dladdr` then tells which module actually defines it, and the address is translated
+ * to the tracee using that module's base address in both processes.
+ */
+bool RemoteElfLoader::resolveImports(const std::vector<MapInfo> &remote_map) {
+    std::vector<void *> handles;
+    for (auto *name : needed_) {
+        if (auto *handle = dlopen(name, RTLD_NOW)) handles.push_back(handle);
+    }
+
+    bool ok = true;
+    auto resolve = [&](uintptr_t table, size_t size) {
+        for (size_t i = 0; ok && i < size / sizeof(Reloc); i++) {
+            const auto &rel = at<Reloc>(table + i * sizeof(Reloc));
+            auto type = RELOC_TYPE(rel.r_info);
+            if (type != R_GENERIC_RELATIVE && type != R_GENERIC_GLOB_DAT &&
+                type != R_GENERIC_JUMP_SLOT && type != R_GENERIC_ABSOLUTE) {
+                LOGW("unsupported relocation type %u", (unsigned) type);
+                ok = false;
+                break;
+            }
+            auto sym_index = RELOC_SYM(rel.r_info);
+            if (sym_index == 0 || symbols_[sym_index].defined || symbols_[sym_index].value != 0) {
+                continue;
+            }
+
+            const auto &sym = dynsym_[sym_index];
+            if (sym.st_shndx != SHN_UNDEF) {
+                symbols_[sym_index] = {true, sym.st_value - min_vaddr_};
+                continue;
+            }
+
+            const char *name = dynstr_ + sym.st_name;
+            void *local = nullptr;
+            for (auto *handle : handles) {
+                if ((local = dlsym(handle, name)) != nullptr) break;
+            }
+            Dl_info info{};
+            if (local == nullptr || dladdr(local, &info) == 0 || info.dli_fname == nullptr) {
+                if (ELF_ST_BIND(sym.st_info) == STB_WEAK) continue;
+                LOGW("cannot resolve symbol %s", name);
+                ok = false;
+                break;
+            }
+            auto remote_base = (uintptr_t) find_module_base(remote_map, info.dli_fname);
+            if (remote_base == 0) {
+                LOGW("%s (needed for %s) is not loaded in the target process", info.dli_fname,
+                     name);
+                ok = false;
+                break;
+            }
+            symbols_[sym_index] = {false,
+                                   remote_base + ((uintptr_t) local - (uintptr_t) info.dli_fbase)};
+        }
+    };
+
+    symbols_.assign(dynsym_count_, Symbol{false, 0});
+    resolve(rel_, rel_size_);
+    resolve(jmprel_, jmprel_size_);
+
+    for (auto *handle : handles) dlclose(handle);
+    return ok;
+}
+
+bool RemoteElfLoader::resolveLibc(const std::vector<MapInfo> &local_map,
+                                  const std::vector<MapInfo> &remote_map) {
+    auto find = [&](const char *name) {
+        return (uintptr_t) find_func_addr(local_map, remote_map, "libc.so", name);
+    };
+    mmap_ = find("mmap");
+    munmap_ = find("munmap");
+    mprotect_ = find("mprotect");
+    syscall_ = find("syscall");
+    ftruncate_ = find("ftruncate");
+    close_ = find("close");
+    return mmap_ && munmap_ && mprotect_ && syscall_ && ftruncate_ && close_;
+}
+
+/**
+ * @brief Applies all relocations to the local image, as if it were mapped at `base`.
+ */
+void RemoteElfLoader::relocate(uintptr_t base) {
+    auto apply = [&](uintptr_t table, size_t size) {
+        for (size_t i = 0; i < size / sizeof(Reloc); i++) {
+            const auto &rel = at<Reloc>(table + i * sizeof(Reloc));
+            auto &target = at<uintptr_t>(rel.r_offset);
+#if defined(USE_RELA)
+            uintptr_t addend = rel.r_addend;
+#else
+            uintptr_t addend = target;
+#endif
+            auto type = RELOC_TYPE(rel.r_info);
+            if (type == R_GENERIC_RELATIVE) {
+                target = base + addend - min_vaddr_;
+                continue;
+            }
+            const auto &sym = symbols_[RELOC_SYM(rel.r_info)];
+            uintptr_t value = sym.defined ? base + sym.value : sym.value;
+            if (type == R_GENERIC_ABSOLUTE) {
+                target = value + addend;
+            } else {
+                // GLOB_DAT and JUMP_SLOT ignore the implicit addend on REL ABIs.
+#if defined(USE_RELA)
+                target = value + addend;
+#else
+                target = value;
+#endif
+            }
+        }
+    };
+    apply(rel_, rel_size_);
+    apply(jmprel_, jmprel_size_);
+
+    // RELR: a bitmap encoding of relative relocations.
+    constexpr size_t WORD_BITS = 8 * sizeof(uintptr_t);
+    uintptr_t where = 0;
+    for (size_t i = 0; i < relr_size_ / sizeof(uintptr_t); i++) {
+        uintptr_t entry = at<uintptr_t>(relr_ + i * sizeof(uintptr_t));
+        if ((entry & 1) == 0) {
+            at<uintptr_t>(entry) += base - min_vaddr_;
+            where = entry + sizeof(uintptr_t);
+            continue;
+        }
+        for (size_t bit = 0; (entry >>= 1) != 0; bit++) {
+            if (entry & 1) at<uintptr_t>(where + bit * sizeof(uintptr_t)) += base - min_vaddr_;
+        }
+        where += (WORD_BITS - 1) * sizeof(uintptr_t);
+    }
+}
+
+void RemoteElfLoader::unmapPartial(int pid, RemoteRegs &regs, uintptr_t return_addr, uintptr_t base,
+                                   long fd) {
+    if (fd >= 0) remote_invoke<void>(pid, regs, close_, return_addr, fd);
+    if (base != 0) remote_invoke<void>(pid, regs, munmap_, return_addr, base, image_.size());
+}
+
+/**
+ * @brief Runs one initializer in the tracee.
+ *
+ * Initializers return nothing, so success is told by the tracee stopping at `return_addr`:
+ * `remote_call` leaves the instruction pointer it stopped at in `regs`, and never sets it to
+ * `return_addr` when the call could not be made.
+ */
+bool RemoteElfLoader::runInitializer(int pid, RemoteRegs &regs, uintptr_t return_addr,
+                                     uintptr_t fn) {
+    regs.ip() = 0;
+    remote_invoke<void>(pid, regs, fn, return_addr, 0, nullptr, nullptr);
+    if (static_cast<uintptr_t>(regs.ip()) != return_addr) {
+        LOGE("initializer at 0x%" PRIxPTR " did not return", fn);
+        return false;
+    }
+    return true;
+}
+
+bool RemoteElfLoader::Load(int pid, RemoteRegs &regs, uintptr_t return_addr, RemoteArena &arena,
+                           Result &out) {
+    const size_t size = image_.size();
+
+    // 1. Reserve the whole range, so that the segments keep their relative layout.
+    auto base = remote_invoke<uintptr_t>(pid, regs, mmap_, return_addr, nullptr, size, PROT_NONE,
+                                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == 0 || base == (uintptr_t) MAP_FAILED) {
+        LOGE("failed to reserve %zu bytes in the target process", size);
+        return false;
+    }
+    relocate(base);
+
+    // 2. Hand the relocated image over through a memfd.
+    auto remote_name = arena.StageString(MEMFD_NAME);
+    if (remote_name == 0 || !arena.Flush()) {
+        unmapPartial(pid, regs, return_addr, base, -1);
+        return false;
+    }
+    auto fd = remote_invoke<long>(pid, regs, syscall_, return_addr, (long) __NR_memfd_create,
+                                  remote_name, MFD_CLOEXEC);
+    if (fd < 0) {
+        LOGE("remote memfd_create failed");
+        unmapPartial(pid, regs, return_addr, base, -1);
+        return false;
+    }
+    if (remote_invoke<long>(pid, regs, ftruncate_, return_addr, fd, size) != 0) {
+        LOGE("remote ftruncate failed");
+        unmapPartial(pid, regs, return_addr, base, fd);
+        return false;
+    }
+    auto view = remote_invoke<uintptr_t>(pid, regs, mmap_, return_addr, nullptr, size,
+                                         PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (view == 0 || view == (uintptr_t) MAP_FAILED) {
+        LOGE("failed to map the memfd in the target process");
+        unmapPartial(pid, regs, return_addr, base, fd);
+        return false;
+    }
+    bool written = write_proc(pid, view, image_.data(), size) == (ssize_t) size;
+    remote_invoke<void>(pid, regs, munmap_, return_addr, view, size);
+    if (!written) {
+        LOGE("failed to write the library image to the target process");
+        unmapPartial(pid, regs, return_addr, base, fd);
+        return false;
+    }
+
+    // 3. Map the segments over the reservation with their final protections.
+    for (const auto &seg : segments_) {
+        auto addr = remote_invoke<uintptr_t>(pid, regs, mmap_, return_addr, base + seg.start,
+                                             seg.size, seg.prot, MAP_PRIVATE | MAP_FIXED, fd,
+                                             seg.start);
+        if (addr != base + seg.start) {
+            LOGE("failed to map segment at offset 0x%" PRIxPTR, seg.start);
+            unmapPartial(pid, regs, return_addr, base, fd);
+            return false;
+        }
+    }
+    if (relro_size_ != 0) {
+        remote_invoke<void>(pid, regs, mprotect_, return_addr, base + relro_start_, relro_size_,
+                            PROT_READ);
+    }
+    remote_invoke<void>(pid, regs, close_, return_addr, fd);
+    LOGV("mapped %zu segments at 0x%" PRIxPTR " (%zu bytes)", segments_.size(), base, size);
+
+    // 4. Run the initializers, in the order the linker would.
+    if (init_ != 0 && !runInitializer(pid, regs, return_addr, base + init_ - min_vaddr_)) {
+        unmapPartial(pid, regs, return_addr, base, -1);
+        return false;
+    }
+    for (size_t i = 0; i < init_array_size_ / sizeof(uintptr_t); i++) {
+        auto fn = at<uintptr_t>(init_array_ + i * sizeof(uintptr_t));
+        if (fn == 0 || fn == UINTPTR_MAX) continue;
+        if (!runInitializer(pid, regs, return_addr, fn)) {
+            unmapPartial(pid, regs, return_addr, base, -1);
+            return false;
+        }
+    }
+
+    out = {base, size, base + entry_};
+    return true;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <link.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "utils.hpp"
+
+/**
+ * @brief Loads a shared library into a tracee without going through its dynamic linker.
+ *
+ * The library is parsed and relocated entirely in the tracer. The tracee only performs a handful
+ * of remote syscalls:
+ * 1.  `mmap` reserves the address range of the image.
+ * 2.  `memfd_create`, `ftruncate` and a temporary shared `mmap` receive the already relocated
+ *     image, written with a single `process_vm_writev`.
+ * 3.  Every PT_LOAD segment is mapped privately from the memfd, with its final protection, over
+ *     the reservation; the RELRO range is then made read-only.
+ * 4.  `DT_INIT` and `DT_INIT_ARRAY` are run.
+ *
+ * No `soinfo` is created, so nothing has to be removed from the linker afterwards, and the cost of
+ * the injection no longer depends on the linker's path resolution and namespace checks.
+ * The flip side is that the image is invisible to `dl_iterate_phdr`, `dladdr` and therefore to
+ * unwinders: a crash inside it yields a backtrace that stops at the first frame of the image.
+ *
+ * An initializer that does not return to the tracer fails `Load()`, which unmaps the image.
+ *
+ * Imported symbols are resolved against the libraries the tracee has already loaded, using the
+ * same local-to-remote offset translation as `find_func_addr`. Anything the loader cannot handle
+ * faithfully (TLS segments, IFUNC or Android-packed relocations, imports from libraries the tracee
+ * has not loaded) is rejected by `Prepare()`, before the tracee is touched, so the caller can fall
+ * back to a remote `dlopen`. Imports are resolved through this process's own libraries, so only
+ * tracees of the tracer's native ABI are supported.
+ */
+class RemoteElfLoader {
+public:
+    struct Result {
+        uintptr_t base = 0;
+        size_t size = 0;
+        uintptr_t entry = 0;
+    };
+
+    /**
+     * @brief Reads and validates the library, and resolves everything that does not depend on
+     *        where it will be mapped.
+     * @param path The library to load.
+     * @param entry_symbol The exported function whose address is reported in the result.
+     * @return False if the library cannot be loaded reflectively.
+     */
+    bool Prepare(const char *path, const char *entry_symbol,
+                 const std::vector<MapInfo> &local_map, const std::vector<MapInfo> &remote_map);
+
+    /**
+     * @brief Maps, relocates and initializes the prepared library in the tracee.
+     *
+     * If a step fails before any code of the library has run, the partial mapping is released and
+     * the tracee is left as it was. A failure while running initializers is not recoverable.
+     */
+    bool Load(int pid, RemoteRegs &regs, uintptr_t return_addr, RemoteArena &arena,
+              Result &out);
+
+private:
+    struct Symbol {
+        bool defined;     // Defined by the library itself; `value` is relative to its base.
+        uintptr_t value;  // Otherwise the absolute remote address, or 0 for a missing weak symbol.
+    };
+
+    struct Segment {
+        uintptr_t start;  // Page-aligned, relative to the image start.
+        size_t size;      // Page-aligned.
+        int prot;
+    };
+
+    bool parseDynamic(uintptr_t dynamic_vaddr);
+    bool resolveImports(const std::vector<MapInfo> &remote_map);
+    bool resolveLibc(const std::vector<MapInfo> &local_map, const std::vector<MapInfo> &remote_map);
+    void relocate(uintptr_t base);
+    void unmapPartial(int pid, RemoteRegs &regs, uintptr_t return_addr, uintptr_t base,
+                      long fd);
+    bool runInitializer(int pid, RemoteRegs &regs, uintptr_t return_addr, uintptr_t fn);
+
+    template <typename T>
+    T &at(uintptr_t vaddr) {
+        return *reinterpret_cast<T *>(image_.data() + (vaddr - min_vaddr_));
+    }
+
+    // The image in its virtual address layout, starting at `min_vaddr_`.
+    std::vector<uint8_t> image_;
+    uintptr_t min_vaddr_ = 0;
+    std::vector<Segment> segments_;
+    uintptr_t relro_start_ = 0;
+    size_t relro_size_ = 0;
+
+    // Dynamic section, as virtual addresses of the unrelocated image.
+    const ElfW(Sym) *dynsym_ = nullptr;
+    size_t dynsym_count_ = 0;
+    const char *dynstr_ = nullptr;
+    std::vector<const char *> needed_;
+    uintptr_t rel_ = 0, rel_size_ = 0;
+    uintptr_t jmprel_ = 0, jmprel_size_ = 0;
+    uintptr_t relr_ = 0, relr_size_ = 0;
+    uintptr_t init_ = 0, init_array_ = 0, init_array_size_ = 0;
+
+    std::vector<Symbol> symbols_;
+    uintptr_t entry_ = 0;
+
+    // Tracee functions used by `Load()`.
+    uintptr_t mmap_ = 0, munmap_ = 0, mprotect_ = 0, syscall_ = 0, ftruncate_ = 0, close_ = 0;
+};
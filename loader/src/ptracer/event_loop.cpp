@@ -33,6 +33,8 @@ void EventLoop::Loop() {
     struct epoll_event events[MAX_EVENTS];
 
     while (running) {
+        // Write out what the previous events logged before blocking again.
+        LogRing::Flush();
         int nfds = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
         if (nfds == -1) {
             if (errno != EINTR) {
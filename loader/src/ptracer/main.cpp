@@ -1,6 +1,7 @@
 #include "main.hpp"
 
 #include <err.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -9,11 +10,15 @@
 #include <csignal>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <string>
 #include <string_view>
 
 #include "daemon.hpp"  // For GetTmpPath
+#include "kernel_caps.hpp"
 #include "logging.hpp"
 #include "monitor.hpp"
+#include "utils.hpp"
 
 // Use string_view literals for efficient, allocation-free string comparisons.
 using namespace std::string_view_literals;
@@ -44,17 +49,100 @@ void send_control_command(Command cmd) {
     sprintf(addr.sun_path, "%s/%s", zygiskd::GetTmpPath().c_str(), AppMonitor::SOCKET_NAME);
     socklen_t socklen = sizeof(sa_family_t) + strlen(addr.sun_path);
 
-    auto nsend = sendto(sockfd, (void *) &cmd, sizeof(cmd), 0, (sockaddr *) &addr, socklen);
+    std::string msg;
+    append_monitor_record(msg, cmd);
+    auto nsend = sendto(sockfd, msg.data(), msg.size(), 0, (sockaddr *) &addr, socklen);
     if (nsend == -1) {
         err(EXIT_FAILURE, "send");
-    } else if (nsend != sizeof(cmd)) {
-        fprintf(stderr, "send %zu != %zu\n", nsend, sizeof(cmd));
+    } else if (nsend != static_cast<ssize_t>(msg.size())) {
+        fprintf(stderr, "send %zd != %zu\n", nsend, msg.size());
         exit(1);
     }
     printf("command sent\n");
     close(sockfd);
 }
 
+/**
+ * @brief Asks the monitor for a statistics snapshot and prints it to standard output.
+ *
+ * The socket is autobound to an abstract address, so that the monitor has somewhere to send its
+ * reply.
+ */
+static int query_monitor_stats() {
+    int sockfd = socket(PF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sockfd == -1) err(EXIT_FAILURE, "socket");
+    struct sockaddr_un self{.sun_family = AF_UNIX, .sun_path = {0}};
+    if (bind(sockfd, (sockaddr *) &self, sizeof(sa_family_t)) == -1) err(EXIT_FAILURE, "bind");
+
+    struct sockaddr_un addr{
+        .sun_family = AF_UNIX,
+        .sun_path = {0},
+    };
+    sprintf(addr.sun_path, "%s/%s", zygiskd::GetTmpPath().c_str(), AppMonitor::SOCKET_NAME);
+    socklen_t socklen = sizeof(sa_family_t) + strlen(addr.sun_path);
+
+    std::string query;
+    append_monitor_record(query, STATS_QUERY);
+    if (sendto(sockfd, query.data(), query.size(), 0, (sockaddr *) &addr, socklen) == -1) {
+        err(EXIT_FAILURE, "send");
+    }
+
+    struct pollfd pfd{.fd = sockfd, .events = POLLIN, .revents = 0};
+    if (poll(&pfd, 1, 1000) != 1) {
+        fprintf(stderr, "error: no reply from the monitor\n");
+        close(sockfd);
+        return EXIT_FAILURE;
+    }
+    std::string reply(64 * 1024, '\0');
+    auto nread = recv(sockfd, reply.data(), reply.size(), 0);
+    close(sockfd);
+    if (nread == -1) err(EXIT_FAILURE, "recv");
+    fwrite(reply.data(), 1, nread, stdout);
+    return EXIT_SUCCESS;
+}
+
+void append_monitor_record(std::string &datagram, Command cmd, std::string_view payload) {
+    if (datagram.empty()) {
+        datagram.append(reinterpret_cast<const char *>(&MONITOR_MSG_MAGIC), sizeof(uint32_t));
+    }
+    auto length = static_cast<uint32_t>(payload.size());
+    datagram.append(reinterpret_cast<const char *>(&cmd), sizeof(cmd));
+    datagram.append(reinterpret_cast<const char *>(&length), sizeof(length));
+    datagram.append(payload);
+}
+
+/**
+ * @brief Sends a command carrying a payload to the monitor.
+ *
+ * Unlike `send_control_command`, failures are only logged: this is used by the tracer, whose
+ * outcome must not depend on whether the monitor is listening.
+ */
+bool send_monitor_message(Command cmd, std::string_view payload) {
+    int sockfd = socket(PF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sockfd == -1) {
+        PLOGE("socket");
+        return false;
+    }
+
+    struct sockaddr_un addr{
+        .sun_family = AF_UNIX,
+        .sun_path = {0},
+    };
+    sprintf(addr.sun_path, "%s/%s", zygiskd::GetTmpPath().c_str(), AppMonitor::SOCKET_NAME);
+    socklen_t socklen = sizeof(sa_family_t) + strlen(addr.sun_path);
+
+    std::string msg;
+    append_monitor_record(msg, cmd, payload);
+
+    auto nsend = sendto(sockfd, msg.data(), msg.size(), 0, (sockaddr *) &addr, socklen);
+    close(sockfd);
+    if (nsend != static_cast<ssize_t>(msg.size())) {
+        PLOGE("send command %d to monitor", static_cast<int>(cmd));
+        return false;
+    }
+    return true;
+}
+
 // --- Command Handler Declarations ---
 
 static void print_usage(const char *tool_name);
@@ -73,6 +161,7 @@ static int handle_version();
 int main(int argc, char **argv) {
     // This initialization is for the daemon's internal logic, not for CLI output.
     zygiskd::Init(getenv("TMP_PATH"));
+    atexit(LogRing::Flush);
 
     if (argc < 2) {
         print_usage(argv[0]);
@@ -104,7 +193,9 @@ int main(int argc, char **argv) {
 static void print_usage(const char *tool_name) {
     fprintf(stderr, "NeoZygisk Tracer %s\n", ZKSU_VERSION);
     fprintf(stderr,
-            "usage: %s monitor | trace <pid> [--restart] | ctl <start|stop|exit> | version\n",
+            "usage: %s monitor | "
+            "trace <pid> [--restart] [--abi <32|64>] [--caps <n>] [--disabled-modules <mask>] | "
+            "ctl <start|stop|exit|stats> | version\n",
             tool_name);
 }
 
@@ -145,13 +236,40 @@ static int handle_trace(int argc, char **argv) {
     pid_t pid = static_cast<pid_t>(pid_val);
     printf("preparing to trace PID: %d\n", pid);
 
-    // Handle optional --restart flag.
-    if (argc >= 4 && argv[3] == "--restart"sv) {
+    // Handle optional flags. The monitor passes the kernel capabilities it probed at startup;
+    // a tracer started by hand probes them itself.
+    bool restart = false;
+    uint32_t caps = 0;
+    bool has_caps = false;
+    uint32_t disabled_modules = 0;
+    std::string_view abi = is_compat_process(pid) ? "32" : LP_SELECT("32", "64");
+    for (int i = 3; i < argc; i++) {
+        if (argv[i] == "--restart"sv) {
+            restart = true;
+        } else if (argv[i] == "--abi"sv && i + 1 < argc) {
+            // The daemon that gets the disabled modules must be the one that counted them.
+            if (argv[++i] != abi) {
+                fprintf(stderr, "error: PID %d is not a %s-bit process\n", pid, argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (argv[i] == "--caps"sv && i + 1 < argc) {
+            caps = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+            has_caps = true;
+        } else if (argv[i] == "--disabled-modules"sv && i + 1 < argc) {
+            disabled_modules = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        } else {
+            fprintf(stderr, "error: unknown trace option '%s'\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!has_caps) caps = kernel_caps::Probe();
+
+    if (restart) {
         printf("zygote restart requested...\n");
-        zygiskd::ZygoteRestart();
+        zygiskd::ZygoteRestart(abi, disabled_modules);
     }
 
-    if (!trace_zygote(pid)) {
+    if (!trace_zygote(pid, caps)) {
         fprintf(stderr,
                 "error: failed to trace zygote, killing process %d to prevent system instability\n",
                 pid);
@@ -170,12 +288,13 @@ static int handle_trace(int argc, char **argv) {
  */
 static int handle_ctl(int argc, char **argv) {
     if (argc < 3) {
-        fprintf(stderr, "error: ctl command requires an action (start|stop|exit)\n");
+        fprintf(stderr, "error: ctl command requires an action (start|stop|exit|stats)\n");
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
 
     const auto action = std::string_view(argv[2]);
+    if (action == "stats"sv) return query_monitor_stats();
     printf("sending control command: '%s'\n", argv[2]);
 
     if (action == "start"sv) {
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
 void init_monitor();
-bool trace_zygote(int pid);
+bool trace_zygote(int pid, uint32_t kernel_caps);
 
 enum Command {
     START = 1,
@@ -11,5 +16,26 @@ enum Command {
     ZYGOTE_INJECTED = 4,
     DAEMON_SET_INFO = 5,
     DAEMON_SET_ERROR_INFO = 6,
-    SYSTEM_SERVER_STARTED = 7
+    SYSTEM_SERVER_STARTED = 7,
+    // sent from tracer; the payload is the zygote ABI ("64" or "32"), a space, then the summary
+    INJECTION_TIMELINE = 8,
+    // sent from daemon periodically; the payload is its counters, one `key=value` per line
+    DAEMON_STATS = 9,
+    // sent from `ctl stats`; the monitor replies to the sender with a `key=value` snapshot
+    STATS_QUERY = 10,
+    // sent from daemon once it listens on its socket
+    DAEMON_READY = 11
 };
+
+/**
+ * Datagrams sent to the monitor, format version 1: the `MONITOR_MSG_MAGIC` word, then one or more
+ * records, each a `Command`, the payload length as a 32-bit unsigned integer, and the payload. All
+ * integers are native-endian. A sender may batch several updates into one datagram, which never
+ * exceeds `MONITOR_MSG_MAX` bytes; the monitor drops datagrams of any other format.
+ */
+constexpr uint32_t MONITOR_MSG_MAGIC = 0x315a4b4d;  // "MKZ1"
+constexpr size_t MONITOR_MSG_MAX = 16 * 1024;
+
+/// Appends a record to `datagram`, starting it with the magic word if it is empty.
+void append_monitor_record(std::string &datagram, Command cmd, std::string_view payload = {});
+bool send_monitor_message(Command cmd, std::string_view payload);
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <array>
 #include <set>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "event_loop.hpp"
@@ -96,10 +101,19 @@ static inline bool stopped_with(int status, int sig, int event) {
  *     these low-level system events into high-level calls and delegates ABI-specific logic to
  *     the appropriate manager.
  *
+ *     Zygote is recognized at `execve` by the (device, inode) of `/proc/<pid>/exe`, compared with
+ *     the identity of each ABI's `app_process` cached by its manager. A **MountWatcher** (Private
+ *     Nested Class) polls the mount table and refreshes that cache whenever it changes, since
+ *     mounts may replace the binary after the monitor started.
+ *
+ *     A **GovernorTimer** (Private Nested Class) wakes each manager's crash governor once a zygote
+ *     has outlived the crash window and when a backoff expires.
+ *
  * 5.  **ZygoteAbiManager**: A helper class that encapsulates all the state (`Status`, counters) and
  *     behavior (daemon creation, crash-loop detection) for a single architecture (64-bit or
  *     32-bit). This prevents code duplication and cleanly separates the logic for managing each
- *     Zygote type.
+ *     Zygote type. A 64-bit monitor owns one for each ABI, since its tracer can also inject the
+ *     32-bit zygote; messages from a daemon are routed to its manager by the sender's PID.
  */
 
 class AppMonitor {
@@ -120,8 +134,17 @@ public:
     void notify_init_detached();
 
     // Public Accessors for owned components
-    ZygoteAbiManager &get_abi_manager();
+    ZygoteAbiManager *find_abi_manager(std::string_view abi_name);
+    /// Returns the manager whose zygote executable is the file `exe` was stat'ed from.
+    ZygoteAbiManager *find_abi_manager_for_exe(const struct stat &exe);
+    /// Like `find_abi_manager_for_exe()`, but re-reads the identities once before giving up.
+    ZygoteAbiManager *find_abi_manager_for_exe_refreshing(const struct stat &exe);
+    ZygoteAbiManager &get_abi_manager_for_daemon(pid_t pid);
+    bool handle_daemon_exit_if_match(int pid, int process_status);
     TracingState get_tracing_state() const;
+    uint32_t get_kernel_caps() const;
+    /// Appends a `key=value` snapshot of the monitor, one pair per line, for `ctl stats`.
+    void write_stats(std::string &out) const;
 
 private:
     class SocketHandler : public EventHandler {
@@ -133,13 +156,26 @@ private:
         ~SocketHandler() override;
 
     private:
-        struct [[gnu::packed]] MsgHead {
+        // Datagrams drained per recvmmsg() call.
+        static constexpr size_t RECV_BATCH = 8;
+
+        struct [[gnu::packed]] RecordHead {
             Command cmd;
-            int length;
-            char data[0];
+            uint32_t length;
         };
+        struct Sender {
+            pid_t pid;  // -1 if unknown
+            // Only set if the sender expects a reply.
+            struct sockaddr_un addr;
+            socklen_t addr_len;
+        };
+        bool handle_datagram(std::string_view datagram, const Sender &sender);
+        bool dispatch(Command cmd, std::string_view payload, const Sender &sender);
+        void reply_stats(const struct sockaddr_un &to, socklen_t to_len);
+
         AppMonitor &monitor_;
-        std::vector<uint8_t> buf_;
+        // RECV_BATCH receive buffers of MONITOR_MSG_MAX bytes each.
+        std::vector<char> buf_;
         int sock_fd_ = -1;
     };
 
@@ -150,6 +186,7 @@ private:
         int GetFd() override;
         void HandleEvent(EventLoop &, uint32_t) override;
         ~SigChldHandler() override;
+        size_t traced_count() const { return process_.size(); }
 
     private:
         void handleChildEvent(int pid, int &status);
@@ -164,17 +201,58 @@ private:
         std::set<pid_t> process_;
     };
 
+    class MountWatcher : public EventHandler {
+    public:
+        explicit MountWatcher(AppMonitor &monitor) : monitor_(monitor) {}
+        bool Init();
+        int GetFd() override;
+        void HandleEvent(EventLoop &, uint32_t) override;
+        ~MountWatcher() override;
+
+    private:
+        AppMonitor &monitor_;
+        int mounts_fd_ = -1;
+    };
+
+    // Wakes the crash governors at their deadlines, so that they need no zygote start to act.
+    class GovernorTimer : public EventHandler {
+    public:
+        explicit GovernorTimer(AppMonitor &monitor) : monitor_(monitor) {}
+        bool Init();
+        int GetFd() override;
+        void HandleEvent(EventLoop &, uint32_t) override;
+        ~GovernorTimer() override;
+        /// Arms the timer for the earliest deadline of any governor, or disarms it.
+        void Arm();
+
+    private:
+        AppMonitor &monitor_;
+        int timer_fd_ = -1;
+    };
+
+#if defined(__LP64__)
+    static constexpr size_t ABI_COUNT = 2;
+#else
+    static constexpr size_t ABI_COUNT = 1;
+#endif
+
     void set_tracing_state(TracingState state);
-    void write_abi_status_section(std::string &status_text, const Status &daemon_status);
+    void refresh_program_identities();
+    void write_abi_status_section(std::string &status_text, const ZygoteAbiManager &zygote);
 
     // Owned Components (Declaration order must match initializer list)
     EventLoop event_loop_;
     SocketHandler socket_handler_;
     SigChldHandler ptrace_handler_;
-    ZygoteAbiManager zygote_;
+    MountWatcher mount_watcher_;
+    GovernorTimer governor_timer_;
+    // The native ABI comes first.
+    std::array<ZygoteAbiManager, ABI_COUNT> zygotes_;
 
     // Private State
     TracingState tracing_state_;
+    // Probed once in prepare_environment() and passed to every tracer.
+    uint32_t kernel_caps_ = 0;
     std::string monitor_stop_reason_;
     std::string prop_path_;
     std::string pre_section_;
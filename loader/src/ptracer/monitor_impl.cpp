@@ -2,15 +2,18 @@
 #include <linux/eventpoll.h>
 #include <sys/signalfd.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <sys/un.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include <csignal>
+#include <cstring>
 #include <sstream>
 
 #include "daemon.hpp"
 #include "files.hpp"
+#include "kernel_caps.hpp"
 #include "logging.hpp"
 #include "monitor.hpp"
 #include "utils.hpp"
@@ -21,22 +24,90 @@ AppMonitor::AppMonitor()
     : event_loop_(),
       socket_handler_(*this),
       ptrace_handler_(*this),
+      mount_watcher_(*this),
+      governor_timer_(*this),
 #if defined(__LP64__)
-      zygote_(*this, true),
+      zygotes_{{{*this, true}, {*this, false}}},
 #else
-      zygote_(*this, false),
+      zygotes_{{{*this, false}}},
 #endif
       tracing_state_(TRACING) {
 }
 
-ZygoteAbiManager &AppMonitor::get_abi_manager() { return zygote_; }
+ZygoteAbiManager *AppMonitor::find_abi_manager(std::string_view abi_name) {
+    for (auto &zygote : zygotes_) {
+        if (abi_name == zygote.abi_name_) return &zygote;
+    }
+    return nullptr;
+}
+
+ZygoteAbiManager *AppMonitor::find_abi_manager_for_exe(const struct stat &exe) {
+    for (auto &zygote : zygotes_) {
+        if (zygote.is_program(exe.st_dev, exe.st_ino)) return &zygote;
+    }
+    return nullptr;
+}
+
+ZygoteAbiManager *AppMonitor::find_abi_manager_for_exe_refreshing(const struct stat &exe) {
+    if (auto zygote = find_abi_manager_for_exe(exe)) return zygote;
+    // A mount may have replaced app_process before the MountWatcher got to see it, e.g. when
+    // both events arrive in the same epoll batch.
+    refresh_program_identities();
+    return find_abi_manager_for_exe(exe);
+}
+
+void AppMonitor::refresh_program_identities() {
+    for (auto &zygote : zygotes_) zygote.refresh_program_identity();
+}
+
+/**
+ * @brief Returns the manager whose daemon has the given PID.
+ *
+ * Falls back to the native ABI if the sender is unknown, e.g. when its credentials were not
+ * delivered.
+ */
+ZygoteAbiManager &AppMonitor::get_abi_manager_for_daemon(pid_t pid) {
+    for (auto &zygote : zygotes_) {
+        if (zygote.get_status().daemon_pid == pid) return zygote;
+    }
+    return zygotes_.front();
+}
+
+bool AppMonitor::handle_daemon_exit_if_match(int pid, int process_status) {
+    for (auto &zygote : zygotes_) {
+        if (zygote.handle_daemon_exit_if_match(pid, process_status)) return true;
+    }
+    return false;
+}
 
 TracingState AppMonitor::get_tracing_state() const { return tracing_state_; }
 
+uint32_t AppMonitor::get_kernel_caps() const { return kernel_caps_; }
+
+void AppMonitor::write_stats(std::string &out) const {
+    static constexpr const char *STATE_NAMES[] = {"", "tracing", "stopping", "stopped", "exiting"};
+    out += "tracing_state=";
+    out += STATE_NAMES[tracing_state_];
+    if (!monitor_stop_reason_.empty()) {
+        out += "\nstop_reason=";
+        out += monitor_stop_reason_;
+    }
+    char caps[16];
+    snprintf(caps, sizeof(caps), "0x%x", kernel_caps_);
+    out += "\nkernel_caps=";
+    out += caps;
+    out += "\ntraced_processes=";
+    out += std::to_string(ptrace_handler_.traced_count());
+    out += "\n";
+    for (const auto &zygote : zygotes_) zygote.write_stats(out);
+}
+
 void AppMonitor::set_tracing_state(TracingState state) { tracing_state_ = state; }
 
-void AppMonitor::write_abi_status_section(std::string &status_text, const Status &daemon_status) {
-    auto abi_name = this->zygote_.abi_name_;
+void AppMonitor::write_abi_status_section(std::string &status_text,
+                                          const ZygoteAbiManager &zygote) {
+    const auto &daemon_status = zygote.get_status();
+    auto abi_name = zygote.abi_name_;
     if (daemon_status.supported) {
         status_text += "\tzygote";
         status_text += abi_name;
@@ -47,6 +118,20 @@ void AppMonitor::write_abi_status_section(std::string &status_text, const Status
             status_text += "\t😋 injected";
         else
             status_text += "\t❌ not injected";
+        if (!daemon_status.injection_timeline.empty()) {
+            status_text += "\n\tinjection";
+            status_text += abi_name;
+            status_text += ":\t#";
+            status_text += std::to_string(daemon_status.injection_count);
+            status_text += " ";
+            status_text += daemon_status.injection_timeline;
+        }
+        if (auto governor = zygote.governor_status(); !governor.empty()) {
+            status_text += "\n\tgovernor";
+            status_text += abi_name;
+            status_text += ":\t⚠️ ";
+            status_text += governor;
+        }
         status_text += "\n\tdaemon";
         status_text += abi_name;
         status_text += ":";
@@ -100,7 +185,13 @@ void AppMonitor::update_status() {
     ss << pre_section_ << "\n" << status_text << "\n\n";
 
     std::string abi_section;
-    write_abi_status_section(abi_section, zygote_.get_status());
+    for (const auto &zygote : zygotes_) {
+        std::string section;
+        write_abi_status_section(section, zygote);
+        if (section.empty()) continue;
+        if (!abi_section.empty()) abi_section += "\n";
+        abi_section += section;
+    }
 
     ss << abi_section << "\n\n" << post_section_;
 
@@ -109,6 +200,12 @@ void AppMonitor::update_status() {
 }
 
 bool AppMonitor::prepare_environment() {
+    kernel_caps_ = kernel_caps::Probe();
+    // Dropping a `trace_marker` file into the module directory enables ftrace markers.
+    if (access("./trace_marker", F_OK) == 0) kernel_caps_ |= kernel_caps::TRACE_MARKER;
+    LOGI("kernel capabilities: 0x%x", kernel_caps_);
+    refresh_program_identities();
+
     prop_path_ = zygiskd::GetTmpPath() + "/module.prop";
     close(open(prop_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
     auto orig_prop = xopen_file("./module.prop", "r");
@@ -135,13 +232,22 @@ bool AppMonitor::prepare_environment() {
 void AppMonitor::run() {
     socket_handler_.Init();
     ptrace_handler_.Init();
+    // Once SIGCHLD is watched, so that an early exit is noticed.
+    for (auto &zygote : zygotes_) zygote.start_daemon();
     event_loop_.Init();
     event_loop_.RegisterHandler(socket_handler_, EPOLLIN | EPOLLET);
     event_loop_.RegisterHandler(ptrace_handler_, EPOLLIN | EPOLLET);
+    // Without the watcher, zygote is still recognized unless a later mount replaces it.
+    if (mount_watcher_.Init()) event_loop_.RegisterHandler(mount_watcher_, EPOLLPRI | EPOLLET);
+    // Without the timer, the governors still act at the next zygote start.
+    if (governor_timer_.Init()) event_loop_.RegisterHandler(governor_timer_, EPOLLIN | EPOLLET);
     event_loop_.Loop();
 }
 
 void AppMonitor::request_start() {
+    // Starting by hand gives every module a fresh chance.
+    for (auto &zygote : zygotes_) zygote.reset_crash_governor();
+    governor_timer_.Arm();
     if (tracing_state_ == STOPPING)
         tracing_state_ = TRACING;
     else if (tracing_state_ == STOPPED) {
@@ -198,77 +304,152 @@ bool AppMonitor::SocketHandler::Init() {
         PLOGE("bind socket");
         return false;
     }
+    buf_.resize(RECV_BATCH * MONITOR_MSG_MAX);
+    // Daemons do not say which ABI they serve; their PID, from the credentials, does.
+    int on = 1;
+    if (setsockopt(sock_fd_, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on)) == -1) {
+        PLOGE("enable SO_PASSCRED");
+    }
     return true;
 }
 
 void AppMonitor::SocketHandler::HandleEvent([[maybe_unused]] EventLoop &loop, uint32_t) {
+    struct mmsghdr msgs[RECV_BATCH];
+    struct iovec iovs[RECV_BATCH];
+    Sender senders[RECV_BATCH];
+    alignas(struct cmsghdr) char controls[RECV_BATCH][CMSG_SPACE(sizeof(struct ucred))];
+    bool status_changed = false;
     for (;;) {
-        buf_.resize(sizeof(MsgHead));
-        MsgHead &msg_header = *reinterpret_cast<MsgHead *>(buf_.data());
-        ssize_t nread = recv(sock_fd_, &msg_header, sizeof(MsgHead), MSG_PEEK | MSG_TRUNC);
-        if (nread == -1) {
-            if (errno == EAGAIN) break;
-            PLOGE("SocketHandler: recv(peek)");
-            continue;
+        for (size_t i = 0; i < RECV_BATCH; ++i) {
+            iovs[i] = {.iov_base = buf_.data() + i * MONITOR_MSG_MAX, .iov_len = MONITOR_MSG_MAX};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_name = &senders[i].addr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(senders[i].addr);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = controls[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+        }
+        int count = recvmmsg(sock_fd_, msgs, RECV_BATCH, MSG_DONTWAIT, nullptr);
+        if (count == -1) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN) PLOGE("SocketHandler: recvmmsg");
+            break;
         }
-        ssize_t real_size;
-        if (msg_header.cmd >= Command::DAEMON_SET_INFO &&
-            msg_header.cmd != Command::SYSTEM_SERVER_STARTED) {
-            if (static_cast<size_t>(nread) < sizeof(MsgHead)) {
-                LOGE("SocketHandler: received incomplete header for cmd %d, size %zd",
-                     msg_header.cmd, nread);
-                recv(sock_fd_, buf_.data(), buf_.size(), 0);
+        for (int i = 0; i < count; ++i) {
+            struct msghdr &hdr = msgs[i].msg_hdr;
+            if (hdr.msg_flags & MSG_TRUNC) {
+                LOGE("SocketHandler: dropping datagram larger than %zu bytes", MONITOR_MSG_MAX);
                 continue;
             }
-            real_size = sizeof(MsgHead) + msg_header.length;
-        } else {
-            if (static_cast<size_t>(nread) != sizeof(Command)) {
-                LOGE("SocketHandler: received invalid size for cmd %d, size %zd", msg_header.cmd,
-                     nread);
-                recv(sock_fd_, buf_.data(), buf_.size(), 0);
-                continue;
+            Sender &sender = senders[i];
+            sender.pid = -1;
+            sender.addr_len = hdr.msg_namelen;
+            for (auto cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS) {
+                    struct ucred cred;
+                    memcpy(&cred, CMSG_DATA(cmsg), sizeof(cred));
+                    sender.pid = cred.pid;
+                }
             }
-            real_size = sizeof(Command);
-        }
-        buf_.resize(real_size);
-        MsgHead &full_msg = *reinterpret_cast<MsgHead *>(buf_.data());
-        nread = recv(sock_fd_, &full_msg, real_size, 0);
-        if (nread == -1) {
-            PLOGE("recv(read)");
-            continue;
-        }
-        if (nread != real_size) {
-            LOGE("SocketHandler: expected %zd bytes, but received %zd", real_size, nread);
-            continue;
+            std::string_view datagram{static_cast<const char *>(iovs[i].iov_base), msgs[i].msg_len};
+            status_changed |= handle_datagram(datagram, sender);
         }
+        if (static_cast<size_t>(count) < RECV_BATCH) break;
+    }
+    // module.prop is rewritten once per wakeup, however many updates arrived.
+    if (status_changed) monitor_.update_status();
+}
 
-        switch (full_msg.cmd) {
-        case START:
-            monitor_.request_start();
-            break;
-        case STOP:
-            monitor_.request_stop("user requested");
-            break;
-        case EXIT:
-            monitor_.request_exit();
-            break;
-        case ZYGOTE_INJECTED:
-            monitor_.get_abi_manager().notify_injected();
-            monitor_.update_status();
-            break;
-        case DAEMON_SET_INFO:
-            monitor_.get_abi_manager().set_daemon_info({full_msg.data, (size_t) full_msg.length});
-            monitor_.update_status();
-            break;
-        case DAEMON_SET_ERROR_INFO:
-            monitor_.get_abi_manager().set_daemon_crashed(
-                {full_msg.data, (size_t) full_msg.length});
-            monitor_.update_status();
+/**
+ * @brief Dispatches every record of a datagram.
+ * @return True if a record changed what module.prop shows.
+ */
+bool AppMonitor::SocketHandler::handle_datagram(std::string_view datagram, const Sender &sender) {
+    uint32_t magic = 0;
+    if (datagram.size() >= sizeof(magic)) memcpy(&magic, datagram.data(), sizeof(magic));
+    if (magic != MONITOR_MSG_MAGIC) {
+        LOGE("SocketHandler: dropping datagram of unknown format, size %zu", datagram.size());
+        return false;
+    }
+    datagram.remove_prefix(sizeof(magic));
+    bool status_changed = false;
+    while (!datagram.empty()) {
+        RecordHead head;
+        if (datagram.size() < sizeof(head)) {
+            LOGE("SocketHandler: truncated record header, size %zu", datagram.size());
             break;
-        case SYSTEM_SERVER_STARTED:
-            LOGV("system server started, module.prop updated");
+        }
+        memcpy(&head, datagram.data(), sizeof(head));
+        datagram.remove_prefix(sizeof(head));
+        if (head.length > datagram.size()) {
+            LOGE("SocketHandler: record of cmd %d claims %u bytes, only %zu left", head.cmd,
+                 head.length, datagram.size());
             break;
         }
+        status_changed |= dispatch(head.cmd, datagram.substr(0, head.length), sender);
+        datagram.remove_prefix(head.length);
+    }
+    return status_changed;
+}
+
+bool AppMonitor::SocketHandler::dispatch(Command cmd, std::string_view payload,
+                                         const Sender &sender) {
+    switch (cmd) {
+    case START:
+        monitor_.request_start();
+        return false;
+    case STOP:
+        monitor_.request_stop("user requested");
+        return false;
+    case EXIT:
+        monitor_.request_exit();
+        return false;
+    case ZYGOTE_INJECTED:
+        monitor_.get_abi_manager_for_daemon(sender.pid).notify_injected();
+        return true;
+    case DAEMON_SET_INFO:
+        monitor_.get_abi_manager_for_daemon(sender.pid).set_daemon_info(payload);
+        return true;
+    case DAEMON_SET_ERROR_INFO:
+        monitor_.get_abi_manager_for_daemon(sender.pid).set_daemon_crashed(payload);
+        return true;
+    case SYSTEM_SERVER_STARTED:
+        LOGV("system server started, module.prop updated");
+        return false;
+    case INJECTION_TIMELINE: {
+        auto space = payload.find(' ');
+        auto zygote = monitor_.find_abi_manager(payload.substr(0, space));
+        if (zygote == nullptr || space == std::string_view::npos) {
+            LOGW("SocketHandler: injection timeline for unknown ABI");
+            return false;
+        }
+        zygote->set_injection_timeline(payload.substr(space + 1));
+        return true;
+    }
+    case DAEMON_STATS:
+        monitor_.get_abi_manager_for_daemon(sender.pid).set_daemon_stats(payload);
+        return false;
+    case STATS_QUERY:
+        reply_stats(sender.addr, sender.addr_len);
+        return false;
+    case DAEMON_READY:
+        monitor_.get_abi_manager_for_daemon(sender.pid).set_daemon_ready();
+        return false;
+    }
+    LOGW("SocketHandler: unknown cmd %d", cmd);
+    return false;
+}
+
+void AppMonitor::SocketHandler::reply_stats(const struct sockaddr_un &to, socklen_t to_len) {
+    if (to_len <= sizeof(sa_family_t)) {
+        LOGW("SocketHandler: stats query from an unbound socket");
+        return;
+    }
+    std::string stats;
+    monitor_.write_stats(stats);
+    if (sendto(sock_fd_, stats.data(), stats.size(), 0, (const sockaddr *) &to, to_len) == -1) {
+        PLOGE("SocketHandler: reply stats");
     }
 }
 
@@ -370,7 +551,7 @@ void AppMonitor::SigChldHandler::handleChildEvent(int pid, int &status) {
         handleInitEvent(pid, status);
         return;
     }
-    if (monitor_.get_abi_manager().handle_daemon_exit_if_match(pid, status)) return;
+    if (monitor_.handle_daemon_exit_if_match(pid, status)) return;
     if (process_.count(pid)) {
         handleTracedProcess(pid, status);
     } else {
@@ -425,16 +606,30 @@ void AppMonitor::SigChldHandler::handleTracedProcess(int pid, int &status) {
 }
 
 void AppMonitor::SigChldHandler::handleExecEvent(int pid, int &status) {
-    auto program = get_program(pid);
-    LOGV("%d program %s", pid, program.c_str());
+    // Compare identities rather than paths: one stat instead of a readlink and string building
+    // on every exec init's descendants make.
+    char exe_path[32];
+    snprintf(exe_path, sizeof(exe_path), "/proc/%d/exe", pid);
+    struct stat exe;
+    if (stat(exe_path, &exe) == -1) {
+        PLOGE("stat %s", exe_path);
+        exe.st_dev = 0;
+        exe.st_ino = 0;
+    }
+    LOGV("%d exec [%lu:%lu]", pid, static_cast<unsigned long>(exe.st_dev),
+         static_cast<unsigned long>(exe.st_ino));
     const char *tracer = nullptr;
+    const char *abi_name = nullptr;
+    uint32_t disabled_modules = 0;
     do {
         if (monitor_.get_tracing_state() != TRACING) {
             LOGW("stop injecting %d because not tracing", pid);
             break;
         }
-        if (program == monitor_.get_abi_manager().program_path_) {
-            tracer = monitor_.get_abi_manager().check_and_prepare_injection();
+        if (auto zygote = monitor_.find_abi_manager_for_exe_refreshing(exe)) {
+            tracer = zygote->check_and_prepare_injection(disabled_modules);
+            abi_name = zygote->abi_name_;
+            monitor_.governor_timer_.Arm();
             if (tracer == nullptr) break;
         }
         if (tracer != nullptr) {
@@ -448,8 +643,12 @@ void AppMonitor::SigChldHandler::handleExecEvent(int pid, int &status) {
                 status = 0;
                 auto p = fork_dont_care();
                 if (p == 0) {
+                    auto caps = std::to_string(monitor_.get_kernel_caps());
+                    auto disabled = std::to_string(disabled_modules);
+                    // The tracer serves every ABI; --abi names the daemon this zygote belongs to.
                     execl(tracer, basename(tracer), "trace", std::to_string(pid).c_str(),
-                          "--restart", nullptr);
+                          "--restart", "--abi", abi_name, "--caps", caps.c_str(),
+                          "--disabled-modules", disabled.c_str(), nullptr);
                     PLOGE("exec");
                     kill(pid, SIGKILL);
                     exit(1);
@@ -462,3 +661,65 @@ void AppMonitor::SigChldHandler::handleExecEvent(int pid, int &status) {
     } while (false);
     monitor_.update_status();
 }
+
+// --- MountWatcher Method Implementations ---
+
+int AppMonitor::MountWatcher::GetFd() { return mounts_fd_; }
+AppMonitor::MountWatcher::~MountWatcher() {
+    if (mounts_fd_ >= 0) close(mounts_fd_);
+}
+
+bool AppMonitor::MountWatcher::Init() {
+    // The kernel signals EPOLLPRI on this file whenever the mount namespace changes.
+    mounts_fd_ = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+    if (mounts_fd_ == -1) {
+        PLOGE("open mountinfo");
+        return false;
+    }
+    return true;
+}
+
+void AppMonitor::MountWatcher::HandleEvent(EventLoop &, uint32_t) {
+    monitor_.refresh_program_identities();
+}
+
+// --- GovernorTimer Method Implementations ---
+
+int AppMonitor::GovernorTimer::GetFd() { return timer_fd_; }
+AppMonitor::GovernorTimer::~GovernorTimer() {
+    if (timer_fd_ >= 0) close(timer_fd_);
+}
+
+bool AppMonitor::GovernorTimer::Init() {
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd_ == -1) {
+        PLOGE("timerfd_create");
+        return false;
+    }
+    return true;
+}
+
+void AppMonitor::GovernorTimer::Arm() {
+    if (timer_fd_ == -1) return;
+    time_t deadline = 0;
+    for (auto &zygote : monitor_.zygotes_) {
+        time_t next = zygote.governor_deadline();
+        if (next != 0 && (deadline == 0 || next < deadline)) deadline = next;
+    }
+    // An all-zero value disarms the timer.
+    struct itimerspec spec{};
+    spec.it_value.tv_sec = deadline;
+    if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) == -1) {
+        PLOGE("timerfd_settime");
+    }
+}
+
+void AppMonitor::GovernorTimer::HandleEvent(EventLoop &, uint32_t) {
+    uint64_t expirations;
+    if (read(timer_fd_, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+        PLOGE("read timerfd");
+    }
+    for (auto &zygote : monitor_.zygotes_) zygote.on_governor_timer();
+    Arm();
+    monitor_.update_status();
+}
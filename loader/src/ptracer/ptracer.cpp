@@ -3,6 +3,7 @@
 #include <link.h>
 #include <signal.h>
 #include <sys/auxv.h>
+#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <sys/ptrace.h>
 #include <sys/system_properties.h>
@@ -17,9 +18,124 @@
 #include <vector>
 
 #include "daemon.hpp"
+#include "elf_loader.hpp"
+#include "event_loop.hpp"
+#include "kernel_caps.hpp"
 #include "logging.hpp"
+#include "main.hpp"
+#include "task.hpp"
+#include "timeline.hpp"
+#include "trace_marker.hpp"
+#include "trace_scheduler.hpp"
 #include "utils.hpp"
 
+// Upper bound for a single ptrace handshake step (seize/attach stop, SIGCONT dance, detach).
+static constexpr int STOP_TIMEOUT_MS = 3000;
+// How long a tracee gets to stop after PTRACE_INTERRUPT before it is given up on.
+static constexpr int INTERRUPT_TIMEOUT_MS = 500;
+// Upper bound for the freshly exec'd zygote to run its dynamic linker and reach AT_ENTRY.
+static constexpr int ENTRY_TIMEOUT_MS = 15000;
+
+/**
+ * @brief Resolves `module!func` in the tracee.
+ *
+ * A native tracee shares our ABI, so the symbol can be located through our own copy of the
+ * module. The libraries of a compat tracee cannot be opened locally; their files are parsed
+ * instead.
+ */
+static uintptr_t find_remote_func(const RemoteRegs &regs, const std::vector<MapInfo> &local_map,
+                                  const std::vector<MapInfo> &map, std::string_view module,
+                                  std::string_view func) {
+    auto addr = regs.compat ? find_func_addr_from_file(map, module, func)
+                            : find_func_addr(local_map, map, module, func);
+    return (uintptr_t) addr;
+}
+
+/**
+ * @brief Loads the library through the tracee's own dynamic linker.
+ *
+ * This is the fallback for libraries that `RemoteElfLoader` cannot handle. It remotely calls
+ * `dlopen()` and `dlsym()`, then rescans the tracee's maps to find where the library was placed.
+ */
+static bool load_with_dlopen(int pid, RemoteRegs &regs, const char *lib_path,
+                             uintptr_t remote_lib_path, uintptr_t remote_entry_str,
+                             const std::vector<MapInfo> &local_map,
+                             const std::vector<MapInfo> &map, uintptr_t libc_return_addr,
+                             InjectionTimeline &timeline, RemoteElfLoader::Result &out) {
+    // Remotely call dlopen(lib_path, RTLD_NOW)
+    LOGV("executing remote call to dlopen(\"%s\")", lib_path);
+    auto dlopen_addr = find_remote_func(regs, local_map, map, "libdl.so", "dlopen");
+    if (dlopen_addr == 0) {
+        LOGE("could not find address of dlopen in the target process");
+        return false;
+    }
+    auto remote_handle = remote_invoke<uintptr_t>(pid, regs, dlopen_addr, libc_return_addr,
+                                                  remote_lib_path, RTLD_NOW);
+
+    if (remote_handle == 0) {
+        LOGE("remote call to dlopen failed, retrieving error message with dlerror");
+        auto dlerror_addr = find_remote_func(regs, local_map, map, "libdl.so", "dlerror");
+        if (dlerror_addr == 0) {
+            LOGE("could not find address of dlerror; cannot retrieve error string");
+            return false;
+        }
+        auto dlerror_str_addr = remote_invoke<uintptr_t>(pid, regs, dlerror_addr, libc_return_addr);
+        if (dlerror_str_addr == 0) {
+            LOGE("remote call to dlerror returned null");
+            return false;
+        }
+        auto strlen_addr = find_remote_func(regs, local_map, map, "libc.so", "strlen");
+        if (strlen_addr == 0) {
+            LOGE("could not find address of strlen; cannot measure error string length");
+            return false;
+        }
+        auto dlerror_len = remote_invoke<size_t>(pid, regs, strlen_addr, libc_return_addr,
+                                                 dlerror_str_addr);
+        if (dlerror_len == 0) {
+            LOGE("dlerror string length is invalid (%zu)", dlerror_len);
+            return false;
+        }
+        std::string err;
+        err.resize(dlerror_len + 1, 0);
+        read_proc(pid, (uintptr_t) dlerror_str_addr, err.data(), dlerror_len);
+        LOGE("dlopen error: %s", err.c_str());
+        return false;
+    }
+    LOGI("successfully loaded library via remote dlopen, handle: 0x%" PRIxPTR, remote_handle);
+    timeline.Mark("dlopen");
+
+    // Remotely call dlsym(handle, "entry")
+    LOGV("executing remote call to dlsym to find the 'entry' symbol");
+    auto dlsym_addr = find_remote_func(regs, local_map, map, "libdl.so", "dlsym");
+    if (dlsym_addr == 0) {
+        LOGE("could not find address of dlsym in the target process");
+        return false;
+    }
+    auto injector_entry = remote_invoke<uintptr_t>(pid, regs, dlsym_addr, libc_return_addr,
+                                                   remote_handle, remote_entry_str);
+
+    if (injector_entry == 0) {
+        LOGE("dlsym failed to find the 'entry' symbol in the injected library");
+        return false;
+    }
+    LOGI("found injector entry point at address 0x%" PRIxPTR, injector_entry);
+    timeline.Mark("dlsym");
+
+    // Find the address range of the injected library to pass to its entry function.
+    out = {0, 0, injector_entry};
+    for (const auto &info : MapInfo::Scan(std::to_string(pid))) {
+        if (info.path.find("libzygisk.so") != std::string::npos) {
+            if (out.base == 0) out.base = info.start;
+            out.size += (info.end - info.start);
+        }
+    }
+    LOGV("found injected library mapped from 0x%" PRIxPTR " with total size %zu", out.base,
+         out.size);
+    timeline.Mark("maps");
+    return true;
+
+}
+
 /**
  * @brief Injects a shared library into a running process at its main entry point.
  *
@@ -39,80 +155,94 @@
  *     way to pause the process at the perfect moment.
  * 4.  **Remote Code Execution**: Once the process is paused, we restore the original entry point.
  *     We then use `ptrace` to execute functions within the target process's context.
- *     - Remotely call `dlopen()` to load our library.
- *     - Remotely call `dlsym()` to find the address of our library's `entry` function.
+ *     - Remotely call `mmap()` to get a scratch arena, and write all strings we need into it.
+ *     - Map, relocate and initialize our library with `RemoteElfLoader`, so that the linker
+ *       never learns about it. If the library cannot be loaded that way, remotely call
+ *       `dlopen()` to load it and `dlsym()` to find the address of its `entry` function.
  *     - Remotely call our `entry` function to initialize NeoZygisk.
+ *     - Remotely call `munmap()` to release the arena.
  * 5.  **Restore State**: After injection, restore all CPU registers, which allows the original
  *     entry point to be called when the process is fully resumed.
  *
+ * A 32-bit zygote is injected the same way by a 64-bit tracer: memory is read in words of the
+ * tracee's ABI, remote calls follow its calling convention, and its functions are resolved from
+ * its own library files.
+ *
+ * Waiting for the entry trap is the only potentially long step, so it is awaited through the
+ * scheduler; the remote calls that follow are short and bounded, and run synchronously.
+ *
+ * @param sched The scheduler driving this tracee.
+ * @param timeline Receives a mark at the end of every step.
  * @param pid The Process ID of the target (e.g., Zygote).
  * @param lib_path The absolute path to the shared library to be injected.
+ * @param kernel_caps The `kernel_caps` bitmap probed by the monitor, handed to the injector.
  * @return True on successful injection, false otherwise.
  */
-bool inject_on_main(int pid, const char *lib_path) {
+static Task<bool> inject_on_main(TraceScheduler &sched, InjectionTimeline &timeline, int pid,
+                                  const char *lib_path, uint32_t kernel_caps) {
     LOGI("starting library injection for PID: %d, library: %s", pid, lib_path);
 
     // Backup of the target's registers, to be restored before detaching.
-    struct user_regs_struct regs{}, backup{};
+    RemoteRegs regs, backup;
     auto map = MapInfo::Scan(std::to_string(pid));
     if (!get_regs(pid, regs)) {
         LOGE("failed to get registers for PID %d, injection aborted", pid);
-        return false;
+        co_return false;
     }
+    if (regs.compat) LOGI("PID %d runs in 32-bit compat mode", pid);
+
+    // Pointers in the tracee are words of its own ABI, which may be narrower than ours.
+    const size_t word = regs.word_size();
+    auto read_word = [pid, word](uintptr_t addr) -> uintptr_t {
+        uintptr_t val = 0;  // Little-endian: a narrower word fills the low bytes.
+        read_proc(pid, addr, &val, word);
+        return val;
+    };
 
     // --- Step 1 & 2: Parse Kernel Argument Block to Find Entry Point ---
     // The stack pointer (SP) at process startup points to the Kernel Argument Block.
     // We parse this structure to locate argc, argv, envp, and the auxiliary vector (auxv).
     // Ref:
     // https://cs.android.com/android/platform/superproject/main/+/main:bionic/libc/private/KernelArgumentBlock.h
-    LOGV("reading kernel argument block from stack pointer: 0x%lx", (unsigned long) regs.REG_SP);
-    auto sp = static_cast<uintptr_t>(regs.REG_SP);
-
-    int argc;
-    read_proc(pid, sp, &argc, sizeof(argc));
+    auto sp = static_cast<uintptr_t>(regs.sp());
+    LOGV("reading kernel argument block from stack pointer: 0x%" PRIxPTR, sp);
 
-    auto argv = reinterpret_cast<char **>(sp + sizeof(uintptr_t));
-    auto envp = argv + argc + 1;
+    auto argc = static_cast<int>(read_word(sp));
+    auto argv = sp + word;
+    auto envp = argv + (argc + 1) * word;
 
     // Iterate past the environment variables to find the start of the auxiliary vector.
     // The end of envp is marked by a null pointer.
     auto p = envp;
-    while (true) {
-        uintptr_t val;
-        read_proc(pid, (uintptr_t) p, &val, sizeof(val));
-        if (val != 0) {
-            p++;
-        } else {
-            break;
-        }
+    while (read_word(p) != 0) {
+        p += word;
     }
-    p++;  // Skip the final null pointer to get to auxv.
-    auto auxv = reinterpret_cast<ElfW(auxv_t) *>(p);
-    LOGV("parsed process startup info: argc=%d, argv=%p, envp=%p, auxv=%p", argc, argv, envp, auxv);
+    p += word;  // Skip the final null pointer to get to auxv.
+    auto auxv = p;
+    LOGV("parsed process startup info: argc=%d, argv=0x%" PRIxPTR ", envp=0x%" PRIxPTR
+         ", auxv=0x%" PRIxPTR,
+         argc, argv, envp, auxv);
 
     // Now, scan the auxiliary vector to find AT_ENTRY. This gives us the program's
-    // entry address, which is where execution will begin.
+    // entry address, which is where execution will begin. Every entry is a pair of words.
     uintptr_t entry_addr = 0;
     uintptr_t addr_of_entry_addr = 0;
-    auto v = auxv;
-    while (true) {
-        ElfW(auxv_t) buf;
-        read_proc(pid, (uintptr_t) v, &buf, sizeof(buf));
-        if (buf.a_type == AT_NULL) {
+    for (auto v = auxv;; v += 2 * word) {
+        auto type = read_word(v);
+        if (type == AT_NULL) {
             break;  // End of auxiliary vector.
         }
-        if (buf.a_type == AT_ENTRY) {
-            entry_addr = (uintptr_t) buf.a_un.a_val;
-            addr_of_entry_addr = (uintptr_t) v + offsetof(ElfW(auxv_t), a_un);
+        if (type == AT_ENTRY) {
+            addr_of_entry_addr = v + word;
+            entry_addr = read_word(addr_of_entry_addr);
             break;
         }
-        v++;
     }
 
     if (entry_addr == 0) {
         LOGE("failed to find AT_ENTRY in auxiliary vector for PID %d, cannot determine entry point",
              pid);
-        return false;
+        co_return false;
     }
     LOGI("found program entry point at 0x%" PRIxPTR, entry_addr);
 
@@ -122,26 +252,31 @@ bool inject_on_main(int pid, const char *lib_path) {
     LOGV("hijacking entry point to intercept execution");
     // For arm32 compatibility, we set the last bit to the same as the entry address.
     uintptr_t break_addr = (-0x05ec1cff & ~1) | (entry_addr & 1);  // An arbitrary invalid address.
-    if (!write_proc(pid, addr_of_entry_addr, &break_addr, sizeof(break_addr))) {
+    if (regs.compat) break_addr = static_cast<uint32_t>(break_addr);
+    if (!write_proc(pid, addr_of_entry_addr, &break_addr, word)) {
         LOGE("failed to write hijack address to PID %d, injection aborted", pid);
-        return false;
+        co_return false;
     }
-
-    int status;
+    timeline.Mark("hijack");
 
     while (true) {
         // Resume execution. We pass 0 to signal to suppress any pending SIGSTOPs.
         if (ptrace(PTRACE_CONT, pid, 0, 0) == -1) {
             PLOGE("ptrace(PTRACE_CONT) failed");
-            return false;
+            co_return false;
         }
 
-        wait_for_trace(pid, &status, __WALL);
+        auto waited = co_await sched.WaitStop(pid, ENTRY_TIMEOUT_MS);
+        if (!waited) {
+            LOGE("process %d did not reach its entry point", pid);
+            co_return false;
+        }
+        int status = *waited;
 
         // 1. Handle Process Death
         if (WIFEXITED(status) || WIFSIGNALED(status)) {
             LOGE("process died unexpectedly: %s", parse_status(status).c_str());
-            return false;
+            co_return false;
         }
 
         // 2. Handle Stops
@@ -157,7 +292,7 @@ bool inject_on_main(int pid, const char *lib_path) {
             } else {
                 // ERROR: Unexpected signal (e.g., SIGILL, SIGBUS). Abort.
                 LOGE("process stopped for unexpected signal: %d", sig);
-                return false;
+                co_return false;
             }
         }
     }
@@ -165,160 +300,117 @@ bool inject_on_main(int pid, const char *lib_path) {
     // Verify we are truly at the trap
     if (!get_regs(pid, regs)) {
         LOGE("failed to get registers after SIGSEGV for PID %d", pid);
-        return false;
+        co_return false;
     }
     // Sanity check: ensure we stopped at our invalid address.
-    if (static_cast<uintptr_t>(regs.REG_IP & ~1) != (break_addr & ~1)) {
-        LOGE("process stopped at unexpected address 0x%lx, expected ~0x%" PRIxPTR, regs.REG_IP,
-             break_addr);
-        return false;
+    if (static_cast<uintptr_t>(regs.ip() & ~1) != (break_addr & ~1)) {
+        LOGE("process stopped at unexpected address 0x%" PRIxPTR ", expected ~0x%" PRIxPTR,
+             (uintptr_t) regs.ip(), break_addr);
+        co_return false;
     }
 
     LOGI("successfully intercepted process %d at its entry point", pid);
+    timeline.Mark("trap");
 
     // --- Step 4: Remote Code Execution ---
     // First, restore the original entry point in memory.
-    if (!write_proc(pid, addr_of_entry_addr, &entry_addr, sizeof(entry_addr))) {
+    if (!write_proc(pid, addr_of_entry_addr, &entry_addr, word)) {
         LOGE("FATAL: failed to restore original entry point, process %d will not recover", pid);
-        return false;
+        co_return false;
     }
 
     // Backup the current registers before we start making remote calls.
-    memcpy(&backup, &regs, sizeof(regs));
+    backup = regs;
     map = MapInfo::Scan(std::to_string(pid));  // Re-scan maps as they may have changed.
     auto local_map = MapInfo::Scan();
     auto libc_return_addr = find_module_return_addr(map, "libc.so");
-
-    // Remotely call dlopen(lib_path, RTLD_NOW)
-    LOGV("executing remote call to dlopen(\"%s\")", lib_path);
-    auto dlopen_addr = find_func_addr(local_map, map, "libdl.so", "dlopen");
-    if (dlopen_addr == nullptr) {
-        LOGE("could not find address of dlopen in the target process");
-        return false;
+    timeline.Mark("maps");
+
+    // Map a scratch arena for all the data our remote calls need, and write it in one go.
+    // It is released again right before the original registers are restored. On failure the
+    // tracee is killed by our caller, so the early returns below do not bother unmapping it.
+    auto mmap_addr = find_remote_func(regs, local_map, map, "libc.so", "mmap");
+    auto munmap_addr = find_remote_func(regs, local_map, map, "libc.so", "munmap");
+    if (mmap_addr == 0 || munmap_addr == 0) {
+        LOGE("could not find address of mmap/munmap in the target process");
+        co_return false;
     }
-    std::vector<long> args;
-    auto remote_lib_path = push_string(pid, regs, lib_path);
-    args.push_back((long) remote_lib_path);
-    args.push_back((long) RTLD_NOW);
-    auto remote_handle =
-        remote_call(pid, regs, (uintptr_t) dlopen_addr, (uintptr_t) libc_return_addr, args);
-
-    if (remote_handle == 0) {
-        LOGE("remote call to dlopen failed, retrieving error message with dlerror");
-        auto dlerror_addr = find_func_addr(local_map, map, "libdl.so", "dlerror");
-        if (dlerror_addr == nullptr) {
-            LOGE("could not find address of dlerror; cannot retrieve error string");
-            return false;
-        }
-        args.clear();
-        auto dlerror_str_addr =
-            remote_call(pid, regs, (uintptr_t) dlerror_addr, (uintptr_t) libc_return_addr, args);
-        if (dlerror_str_addr == 0) {
-            LOGE("remote call to dlerror returned null");
-            return false;
-        }
-        auto strlen_addr = find_func_addr(local_map, map, "libc.so", "strlen");
-        if (strlen_addr == nullptr) {
-            LOGE("could not find address of strlen; cannot measure error string length");
-            return false;
-        }
-        args.clear();
-        args.push_back(dlerror_str_addr);
-        auto dlerror_len =
-            remote_call(pid, regs, (uintptr_t) strlen_addr, (uintptr_t) libc_return_addr, args);
-        if (dlerror_len <= 0) {
-            LOGE("dlerror string length is invalid (%" PRIuPTR ")", dlerror_len);
-            return false;
-        }
-        std::string err;
-        err.resize(dlerror_len + 1, 0);
-        read_proc(pid, (uintptr_t) dlerror_str_addr, err.data(), dlerror_len);
-        LOGE("dlopen error: %s", err.c_str());
-        return false;
+    RemoteArena arena;
+    if (!arena.Map(pid, regs, mmap_addr, (uintptr_t) libc_return_addr)) {
+        co_return false;
     }
-    LOGI("successfully loaded library via remote dlopen, handle: 0x%" PRIxPTR, remote_handle);
-
-    // Remotely call dlsym(handle, "entry")
-    LOGV("executing remote call to dlsym to find the 'entry' symbol");
-    auto dlsym_addr = find_func_addr(local_map, map, "libdl.so", "dlsym");
-    if (dlsym_addr == nullptr) {
-        LOGE("could not find address of dlsym in the target process");
-        return false;
+    auto remote_lib_path = arena.StageString(lib_path);
+    auto remote_entry_str = arena.StageString("entry");
+    auto remote_tmp_path = arena.StageString(zygiskd::GetTmpPath());
+    if (remote_lib_path == 0 || remote_entry_str == 0 || remote_tmp_path == 0 || !arena.Flush()) {
+        LOGE("failed to prepare injection data in the target process");
+        co_return false;
     }
-    args.clear();
-    auto remote_entry_str = push_string(pid, regs, "entry");
-    args.push_back(remote_handle);
-    args.push_back((long) remote_entry_str);
-    auto injector_entry =
-        remote_call(pid, regs, (uintptr_t) dlsym_addr, (uintptr_t) libc_return_addr, args);
-
-    if (injector_entry == 0) {
-        LOGE("dlsym failed to find the 'entry' symbol in the injected library");
-        return false;
-    }
-    LOGI("found injector entry point at address 0x%" PRIxPTR, injector_entry);
-
-    // Find the address range of the injected library to pass to its entry function.
-    map = MapInfo::Scan(std::to_string(pid));
-    void *start_addr = nullptr;
-    size_t block_size = 0;
-    for (const auto &info : map) {
-        if (info.path.find("libzygisk.so") != std::string::npos) {
-            if (start_addr == nullptr) start_addr = (void *) info.start;
-            block_size += (info.end - info.start);
+    timeline.Mark("arena");
+
+    // Load the library: reflectively if possible, through the tracee's linker otherwise.
+    // The reflective loader resolves imports through our own libraries, so it needs a native
+    // tracee.
+    RemoteElfLoader loader;
+    RemoteElfLoader::Result loaded;
+    if (!regs.compat && loader.Prepare(lib_path, "entry", local_map, map) &&
+        loader.Load(pid, regs, (uintptr_t) libc_return_addr, arena, loaded)) {
+        LOGI("loaded library reflectively at 0x%" PRIxPTR ", entry point at 0x%" PRIxPTR,
+             loaded.base, loaded.entry);
+        timeline.Mark("load");
+    } else {
+        LOGW("reflective loading not possible, falling back to remote dlopen");
+        if (!load_with_dlopen(pid, regs, lib_path, remote_lib_path, remote_entry_str, local_map,
+                              map, (uintptr_t) libc_return_addr, timeline, loaded)) {
+            co_return false;
         }
     }
-    LOGV("found injected library mapped from %p with total size %zu", start_addr, block_size);
+    auto injector_entry = loaded.entry;
+    auto start_addr = (void *) loaded.base;
+    size_t block_size = loaded.size;
 
-    // Remotely call our entry(start_addr, block_size, path) function
+    // Remotely call our entry(start_addr, block_size, path, kernel_caps) function
     LOGI("calling the injector's entry function to initialize NeoZygisk");
-    args.clear();
-    args.push_back((uintptr_t) start_addr);
-    args.push_back(block_size);
-    auto remote_tmp_path = push_string(pid, regs, zygiskd::GetTmpPath().c_str());
-    args.push_back((long) remote_tmp_path);
-    remote_call(pid, regs, injector_entry, (uintptr_t) libc_return_addr, args);
+    remote_invoke<void>(pid, regs, injector_entry, (uintptr_t) libc_return_addr, start_addr,
+                        block_size, remote_tmp_path, kernel_caps);
+    timeline.Mark("entry");
+
+    arena.Unmap(regs, munmap_addr, (uintptr_t) libc_return_addr);
 
     // --- Step 5: Restore State ---
     // Set the instruction pointer back to the original entry address and restore all registers.
-    backup.REG_IP = (long) entry_addr;
+    backup.ip() = entry_addr;
     LOGI("injection complete, restoring registers before resuming normal execution");
     if (!set_regs(pid, backup)) {
         LOGE("failed to restore original registers for PID %d", pid);
-        return false;
+        co_return false;
     }
 
-    return true;
+    co_return true;
 }
 
 // Macro helper to check for specific ptrace stop events.
 #define STOPPED_WITH(sig, event)                                                                   \
     (WIFSTOPPED(status) && WSTOPSIG(status) == (sig) && (status >> 16) == (event))
 
-// Common wait routine to avoid repetition.
-// Returns false if wait failed or process died unexpectedly.
-static bool wait_for_process(int pid, int *status) {
-    if (waitpid(pid, status, __WALL) < 0) {
-        PLOGE("waitpid on PID %d", pid);
-        return false;
-    }
-    return true;
-}
-
 /**
  * @brief Injects the Zygisk library into the main thread.
  *
  * Shared logic between Seize and Attach methods.
  */
-static bool perform_injection(int pid) {
+static Task<bool> perform_injection(TraceScheduler &sched, InjectionTimeline &timeline, int pid,
+                                     uint32_t kernel_caps) {
+    // A compat zygote needs the 32-bit build of the library.
     std::string lib_path = zygiskd::GetTmpPath();
-    lib_path += "/lib" LP_SELECT("", "64") "/libzygisk.so";
+    lib_path += is_compat_process(pid) ? "/lib/libzygisk.so"
+                                       : "/lib" LP_SELECT("", "64") "/libzygisk.so";
 
-    if (!inject_on_main(pid, lib_path.c_str())) {
+    trace_marker::Scope trace("zygisk:inject", pid);
+    if (!co_await inject_on_main(sched, timeline, pid, lib_path.c_str(), kernel_caps)) {
         LOGE("failed to inject library into zygote (PID: %d)", pid);
-        return false;
+        co_return false;
     }
-    return true;
+    co_return true;
 }
 
 /**
@@ -327,181 +419,268 @@ static bool perform_injection(int pid) {
  * Advances the process by one syscall to clear internal kernel ptrace state
  * before finally detaching.
  */
-static bool detach_with_gki_workaround(int pid, int detach_signal) {
-    int status;
+static Task<bool> detach_with_gki_workaround(TraceScheduler &sched, InjectionTimeline &timeline,
+                                             int pid, int detach_signal) {
     LOGV("applying GKI 2.0 workaround (step syscall) before detach");
 
     // 1. Advance to next syscall entry/exit to clear signal-stop state
     if (ptrace(PTRACE_SYSCALL, pid, 0, 0) == -1) {
         PLOGE("ptrace(PTRACE_SYSCALL) on PID %d", pid);
         ptrace(PTRACE_DETACH, pid, 0, detach_signal);  // Try to detach anyway
-        return false;
+        co_return false;
     }
 
     // 2. Wait for the syscall stop
-    if (!wait_for_process(pid, &status)) {
+    if (!co_await sched.WaitStop(pid, STOP_TIMEOUT_MS)) {
         // If wait fails, force detach
         ptrace(PTRACE_DETACH, pid, 0, detach_signal);
-        return false;
+        co_return false;
     }
 
     // 3. Clean detach
     if (ptrace(PTRACE_DETACH, pid, 0, detach_signal) == -1) {
         PLOGE("ptrace(PTRACE_DETACH) on PID %d", pid);
-        return false;
+        co_return false;
     }
-    return true;
+    timeline.Mark("detach");
+    co_return true;
 }
 
-// --- Strategy 1: PTRACE_SEIZE (Preferred) ---
-
-static bool trace_with_seize(int pid) {
-    LOGI("attempting trace_seize on PID %d", pid);
-
-    // PTRACE_O_EXITKILL ensures Zygote dies if we crash, preventing a zombie state.
-    if (ptrace(PTRACE_SEIZE, pid, 0, PTRACE_O_EXITKILL) == -1) {
-        // We do not return false here immediately; we let the caller handle errno.
-        return false;
+/**
+ * @brief Detaches from a seized tracee after a failed step, whether or not it is stopped.
+ *
+ * PTRACE_DETACH fails with ESRCH unless the tracee is stopped, which it may not be after a step
+ * timed out. It is then interrupted, and the resulting stop awaited for a bounded time. A tracee
+ * that does not stop even so stays seized; it is killed by PTRACE_O_EXITKILL when the tracer
+ * exits, as `handle_trace` would do for a failed injection anyway.
+ *
+ * @return Always false, the result of the failed step.
+ */
+static Task<bool> detach_after_failure(TraceScheduler &sched, int pid) {
+    if (ptrace(PTRACE_DETACH, pid, 0, 0) == 0 || errno != ESRCH) co_return false;
+    if (ptrace(PTRACE_INTERRUPT, pid, 0, 0) == -1) {
+        PLOGE("ptrace(PTRACE_INTERRUPT) on PID %d", pid);
+        co_return false;
     }
+    if (!co_await sched.WaitStop(pid, INTERRUPT_TIMEOUT_MS) ||
+        ptrace(PTRACE_DETACH, pid, 0, 0) == -1) {
+        LOGW("could not detach from PID %d, leaving it to PTRACE_O_EXITKILL", pid);
+    }
+    co_return false;
+}
 
-    int status;
+// --- Strategy 1: PTRACE_SEIZE (Preferred) ---
+
+/**
+ * @brief Drives an already seized tracee through injection and the SIGCONT dance.
+ */
+static Task<bool> trace_with_seize(TraceScheduler &sched, InjectionTimeline &timeline, int pid,
+                                    uint32_t kernel_caps) {
 // Helper macro for local flow control
 #define BAIL_AND_DETACH                                                                            \
-    ptrace(PTRACE_DETACH, pid, 0, 0);                                                              \
-    return false;
+    co_return co_await detach_after_failure(sched, pid);
 
     // Wait for the initial Seize stop
-    if (!wait_for_process(pid, &status)) return false;
+    auto waited = co_await sched.WaitStop(pid, STOP_TIMEOUT_MS);
+    if (!waited) {
+        BAIL_AND_DETACH
+    }
+    int status = *waited;
 
     // SEIZE usually stops with SIGSTOP + PTRACE_EVENT_STOP
-    if (STOPPED_WITH(SIGSTOP, PTRACE_EVENT_STOP)) {
-        // 1. Inject Payload
-        if (!perform_injection(pid)) {
-            BAIL_AND_DETACH
-        }
+    if (!STOPPED_WITH(SIGSTOP, PTRACE_EVENT_STOP)) {
+        LOGE("seize attached, but unexpected initial state: %s", parse_status(status).c_str());
+        BAIL_AND_DETACH
+    }
+    timeline.Mark("seize");
 
-        LOGV("injection complete, starting signal continuation sequence");
+    // 1. Inject Payload
+    if (!co_await perform_injection(sched, timeline, pid, kernel_caps)) {
+        BAIL_AND_DETACH
+    }
 
-        // 2. Send SIGCONT to the process
-        if (kill(pid, SIGCONT) == -1) {
-            PLOGE("kill(SIGCONT) on PID %d", pid);
-            BAIL_AND_DETACH
-        }
+    LOGV("injection complete, starting signal continuation sequence");
 
-        // 3. Resume (PTRACE_CONT)
-        if (ptrace(PTRACE_CONT, pid, 0, 0) == -1) {
-            PLOGE("ptrace(PTRACE_CONT) failed");
-            BAIL_AND_DETACH
-        }
-        if (!wait_for_process(pid, &status)) return false;
+    // 2. Send SIGCONT to the process
+    if (kill(pid, SIGCONT) == -1) {
+        PLOGE("kill(SIGCONT) on PID %d", pid);
+        BAIL_AND_DETACH
+    }
 
-        // 4. Expect SIGTRAP (caused by the signal interruption in Seize mode)
-        if (STOPPED_WITH(SIGTRAP, PTRACE_EVENT_STOP)) {
-            if (ptrace(PTRACE_CONT, pid, 0, 0) == -1) {
-                BAIL_AND_DETACH
-            }
-            if (!wait_for_process(pid, &status)) return false;
+    // 3. Resume (PTRACE_CONT)
+    if (ptrace(PTRACE_CONT, pid, 0, 0) == -1) {
+        PLOGE("ptrace(PTRACE_CONT) failed");
+        BAIL_AND_DETACH
+    }
+    waited = co_await sched.WaitStop(pid, STOP_TIMEOUT_MS);
+    if (!waited) {
+        BAIL_AND_DETACH
+    }
+    status = *waited;
 
-            // 5. Expect the actual SIGCONT delivery
-            if (STOPPED_WITH(SIGCONT, 0)) {
-                LOGV("received expected SIGCONT");
-                // 6. Workaround + Detach
-                return detach_with_gki_workaround(pid, SIGCONT);
-            } else {
-                LOGE("unexpected state after SIGTRAP: %s", parse_status(status).c_str());
-                BAIL_AND_DETACH
-            }
-        } else {
-            LOGE("expected SIGTRAP after CONT, got: %s", parse_status(status).c_str());
-            BAIL_AND_DETACH
-        }
-    } else {
-        LOGE("seize attached, but unexpected initial state: %s", parse_status(status).c_str());
+    // 4. Expect SIGTRAP (caused by the signal interruption in Seize mode)
+    if (!STOPPED_WITH(SIGTRAP, PTRACE_EVENT_STOP)) {
+        LOGE("expected SIGTRAP after CONT, got: %s", parse_status(status).c_str());
+        BAIL_AND_DETACH
+    }
+    if (ptrace(PTRACE_CONT, pid, 0, 0) == -1) {
+        BAIL_AND_DETACH
+    }
+    waited = co_await sched.WaitStop(pid, STOP_TIMEOUT_MS);
+    if (!waited) {
         BAIL_AND_DETACH
     }
+    status = *waited;
+
+    // 5. Expect the actual SIGCONT delivery
+    if (!STOPPED_WITH(SIGCONT, 0)) {
+        LOGE("unexpected state after SIGTRAP: %s", parse_status(status).c_str());
+        BAIL_AND_DETACH
+    }
+    LOGV("received expected SIGCONT");
+    timeline.Mark("resume");
+
+    // 6. Workaround + Detach
+    co_return co_await detach_with_gki_workaround(sched, timeline, pid, SIGCONT);
 
 #undef BAIL_AND_DETACH
-    return true;
 }
 
 // --- Strategy 2: PTRACE_ATTACH (Fallback) ---
 
-static bool trace_with_attach(int pid) {
-    LOGI("falling back to trace_attach on PID %d", pid);
-
-    // Classic attach. This sends SIGSTOP to the process immediately.
-    if (ptrace(PTRACE_ATTACH, pid, 0, 0) == -1) {
-        PLOGE("ptrace(PTRACE_ATTACH) on PID %d", pid);
-        return false;
-    }
-
-    int status;
-    if (!wait_for_process(pid, &status)) {
-        // If wait fails, we must try to detach or the process hangs forever
-        ptrace(PTRACE_DETACH, pid, 0, 0);
-        return false;
+/**
+ * @brief Drives an already attached tracee through injection.
+ */
+static Task<bool> trace_with_attach(TraceScheduler &sched, InjectionTimeline &timeline, int pid,
+                                     uint32_t kernel_caps) {
+    auto waited = co_await sched.WaitStop(pid, STOP_TIMEOUT_MS);
+    if (!waited) {
+        // The tracee never stopped, so it cannot be detached, and without PTRACE_SEIZE it cannot
+        // be interrupted either; `handle_trace` kills it once this tracer reports the failure.
+        co_return false;
     }
+    int status = *waited;
 
     // Classic ATTACH results in a STOPPED status with SIGSTOP.
     // It does NOT use PTRACE_EVENT_STOP in the status bits usually.
-    if (WIFSTOPPED(status) && WSTOPSIG(status) == SIGSTOP) {
-        // Optional: Set EXITKILL for parity with SEIZE, though not strictly required for fallback.
-        ptrace(PTRACE_SETOPTIONS, pid, 0, PTRACE_O_EXITKILL);
-
-        // 1. Inject Payload
-        if (!perform_injection(pid)) {
-            ptrace(PTRACE_DETACH, pid, 0, 0);
-            return false;
-        }
+    if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGSTOP) {
+        LOGE("attach succeeded but process state unexpected: %s", parse_status(status).c_str());
+        ptrace(PTRACE_DETACH, pid, 0, 0);
+        co_return false;
+    }
 
-        // 2. Detach
-        // For classic attach, we don't need the SIGTRAP/SIGCONT dance because
-        // we haven't manually sent a SIGCONT via kill().
-        // The process is simply stopped by the attach.
-        // We use the GKI workaround to ensure the detach is clean.
-        // We pass SIGCONT to detach to ensure the process resumes.
-        return detach_with_gki_workaround(pid, SIGCONT);
+    // Optional: Set EXITKILL for parity with SEIZE, though not strictly required for fallback.
+    ptrace(PTRACE_SETOPTIONS, pid, 0, PTRACE_O_EXITKILL);
+    timeline.Mark("attach");
 
-    } else {
-        LOGE("attach succeeded but process state unexpected: %s", parse_status(status).c_str());
+    // 1. Inject Payload
+    if (!co_await perform_injection(sched, timeline, pid, kernel_caps)) {
         ptrace(PTRACE_DETACH, pid, 0, 0);
-        return false;
+        co_return false;
     }
+
+    // 2. Detach
+    // For classic attach, we don't need the SIGTRAP/SIGCONT dance because
+    // we haven't manually sent a SIGCONT via kill().
+    // The process is simply stopped by the attach.
+    // We use the GKI workaround to ensure the detach is clean.
+    // We pass SIGCONT to detach to ensure the process resumes.
+    co_return co_await detach_with_gki_workaround(sched, timeline, pid, SIGCONT);
 }
 
 /**
- * @brief Attaches to the Zygote process and initiates the injection.
+ * @brief The complete tracing routine for a single zygote.
  *
  * Tries modern PTRACE_SEIZE first. If that fails with I/O error (EIO),
  * falls back to classic PTRACE_ATTACH.
- *
- * @param pid The Zygote process ID.
- * @return True on success, false on failure.
  */
-bool trace_zygote(int pid) {
-    LOGI("attaching to zygote (PID: %d) to begin injection", pid);
-
+static Task<bool> trace_zygote_steps(TraceScheduler &sched, InjectionTimeline &timeline, int pid,
+                                      uint32_t kernel_caps) {
     // 1. Try SEIZE (Modern, robust handling of group stops)
-    if (trace_with_seize(pid)) {
-        LOGI("successfully detached from zygote (via SEIZE), NeoZygisk active");
-        return true;
+    // PTRACE_O_EXITKILL ensures Zygote dies if we crash, preventing a zombie state.
+    LOGI("attempting trace_seize on PID %d", pid);
+    if (ptrace(PTRACE_SEIZE, pid, 0, PTRACE_O_EXITKILL) == 0) {
+        if (co_await trace_with_seize(sched, timeline, pid, kernel_caps)) {
+            LOGI("successfully detached from zygote (via SEIZE), NeoZygisk active");
+            co_return true;
+        }
+        co_return false;
     }
 
     // 2. Check for fallback condition
     // PTRACE_SEIZE returns EIO if the process state prohibits seizing,
     // or sometimes if security modules interfere.
-    if (errno == EIO) {
-        LOGW("PTRACE_SEIZE failed with EIO, attempting fallback to PTRACE_ATTACH");
-
-        if (trace_with_attach(pid)) {
-            LOGI("successfully detached from zygote (via ATTACH), NeoZygisk active");
-            return true;
-        }
-    } else {
+    if (errno != EIO) {
         // If it wasn't EIO (e.g., EPERM, ESRCH), Attach will likely fail too,
         // or the error is fatal.
         PLOGE("PTRACE_SEIZE failed (errno: %d)", errno);
+        co_return false;
+    }
+    LOGW("PTRACE_SEIZE failed with EIO, attempting fallback to PTRACE_ATTACH");
+
+    // Classic attach. This sends SIGSTOP to the process immediately.
+    LOGI("falling back to trace_attach on PID %d", pid);
+    if (ptrace(PTRACE_ATTACH, pid, 0, 0) == -1) {
+        PLOGE("ptrace(PTRACE_ATTACH) on PID %d", pid);
+        co_return false;
+    }
+    if (co_await trace_with_attach(sched, timeline, pid, kernel_caps)) {
+        LOGI("successfully detached from zygote (via ATTACH), NeoZygisk active");
+        co_return true;
+    }
+    co_return false;
+}
+
+/**
+ * @brief Traces a single zygote and reports how long each step took.
+ *
+ * The timeline summary is forwarded to the monitor whether or not the injection succeeded, so
+ * that slow or failing steps show up in the module status.
+ */
+static Task<bool> trace_zygote_task(TraceScheduler &sched, int pid, uint32_t kernel_caps) {
+    InjectionTimeline timeline;
+    bool ok = co_await trace_zygote_steps(sched, timeline, pid, kernel_caps);
+
+    auto summary = timeline.Summary();
+    LOGI("injection timeline for PID %d: %s", pid, summary.c_str());
+    if (!ok) summary.insert(0, "failed: ");
+    // The monitor keeps one status per zygote ABI.
+    summary.insert(0, is_compat_process(pid) ? "32 " : LP_SELECT("32 ", "64 "));
+    send_monitor_message(Command::INJECTION_TIMELINE, summary);
+
+    co_return ok;
+}
+
+/**
+ * @brief Attaches to the Zygote process and initiates the injection.
+ *
+ * The tracing routine runs as a coroutine on a private EventLoop: every wait for a ptrace-stop
+ * is bounded by a per-step timeout, and any failure is reported back instead of terminating the
+ * tracer. The monitor execs one tracer per zygote, so each loop only ever drives a single tracee;
+ * see `TraceScheduler` for why tracing stays out of the monitor's loop.
+ *
+ * @param pid The Zygote process ID.
+ * @param kernel_caps The `kernel_caps` bitmap to hand to the injector.
+ * @return True on success, false on failure.
+ */
+bool trace_zygote(int pid, uint32_t kernel_caps) {
+    LOGI("attaching to zygote (PID: %d) to begin injection", pid);
+    if (kernel_caps & kernel_caps::TRACE_MARKER) trace_marker::Open();
+
+    EventLoop loop;
+    TraceScheduler sched;
+    TraceScheduler::ChildWatcher watcher(sched);
+    if (!loop.Init() || !sched.Init() || !watcher.Init()) return false;
+    if (!loop.RegisterHandler(sched, EPOLLIN | EPOLLET) ||
+        !loop.RegisterHandler(watcher, EPOLLIN | EPOLLET)) {
+        return false;
     }
 
-    return false;
+    bool result = false;
+    sched.Spawn(trace_zygote_task(sched, pid, kernel_caps), [&](bool ok) {
+        result = ok;
+        loop.Stop();
+    });
+    if (!sched.Idle()) loop.Loop();
+    return result;
 }
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+/**
+ * @brief A lazily-started, single-consumer C++20 coroutine returning a value of type T.
+ *
+ * A Task does not run until it is either awaited by another coroutine or explicitly started
+ * with `start()`. When it finishes, control is transferred directly back to the awaiting
+ * coroutine (symmetric transfer), so deeply nested tracing steps do not grow the native stack.
+ *
+ * The ptracer is built with `-fno-exceptions`; `unhandled_exception()` therefore only exists to
+ * satisfy the promise contract and terminates the process.
+ *
+ * @tparam T The result type. It must be default-constructible and movable.
+ */
+template <typename T>
+class [[nodiscard]] Task {
+public:
+    struct promise_type {
+        T value{};
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object() {
+            return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        auto final_suspend() noexcept {
+            struct FinalAwaiter {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(
+                    std::coroutine_handle<promise_type> h) noexcept {
+                    auto next = h.promise().continuation;
+                    return next ? next : std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+            return FinalAwaiter{};
+        }
+
+        void return_value(T v) { value = std::move(v); }
+
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+    ~Task() {
+        if (handle_) handle_.destroy();
+    }
+
+    // A Task owns its coroutine frame; it can be moved but not copied.
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            if (handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+
+    // --- Awaiter interface, used when a coroutine does `co_await task` ---
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        handle_.promise().continuation = caller;
+        return handle_;
+    }
+
+    T await_resume() { return std::move(handle_.promise().value); }
+
+    // --- Root task interface, used by the scheduler ---
+
+    void start() { handle_.resume(); }
+
+    bool done() const { return !handle_ || handle_.done(); }
+
+    T &result() { return handle_.promise().value; }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <time.h>
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/**
+ * @brief A fixed-capacity recorder of monotonic timestamps for the injection steps.
+ *
+ * Every call to `Mark()` closes the step that started at the previous mark. The recorder never
+ * allocates while marking, so it can be used freely on the injection hot path; only `Summary()`
+ * builds a string, once everything is done.
+ *
+ * The summary is a single line of `label=duration` pairs followed by the total, e.g.
+ * `seize=0.4ms hijack=0.1ms trap=38.2ms maps=1.3ms dlopen=9.8ms ... total=55.0ms`, which is
+ * compact enough to be forwarded to the monitor in one control datagram.
+ */
+class InjectionTimeline {
+public:
+    static constexpr size_t MAX_MARKS = 16;
+
+    InjectionTimeline() { start_ns_ = now_ns(); }
+
+    /// Records the end of the step named `label`. The label must be a string literal.
+    void Mark(const char *label) {
+        if (count_ == MAX_MARKS) return;
+        marks_[count_++] = {label, now_ns()};
+    }
+
+    std::string Summary() const {
+        std::string out;
+        char buf[48];
+        uint64_t prev = start_ns_;
+        for (size_t i = 0; i < count_; i++) {
+            snprintf(buf, sizeof(buf), "%s=%.1fms ", marks_[i].label, to_ms(marks_[i].ns - prev));
+            out += buf;
+            prev = marks_[i].ns;
+        }
+        snprintf(buf, sizeof(buf), "total=%.1fms", to_ms(prev - start_ns_));
+        out += buf;
+        return out;
+    }
+
+private:
+    struct Entry {
+        const char *label;
+        uint64_t ns;
+    };
+
+    static uint64_t now_ns() {
+        struct timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    static double to_ms(uint64_t ns) { return static_cast<double>(ns) / 1e6; }
+
+    uint64_t start_ns_;
+    std::array<Entry, MAX_MARKS> marks_{};
+    size_t count_ = 0;
+};
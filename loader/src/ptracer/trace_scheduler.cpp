@@ -0,0 +1,229 @@
+#include "trace_scheduler.hpp"
+
+#include <sys/ptrace.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <iterator>
+
+#include "logging.hpp"
+#include "utils.hpp"
+
+static uint64_t monotonic_ms() {
+    struct timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+// --- StopAwaiter ---
+
+TraceScheduler::StopAwaiter::StopAwaiter(TraceScheduler &scheduler, int pid, int timeout_ms)
+    : scheduler_(scheduler),
+      pid_(pid),
+      deadline_ms_(timeout_ms > 0 ? monotonic_ms() + timeout_ms : UINT64_MAX) {}
+
+/**
+ * @brief Completes the wait synchronously if the tracee has already stopped.
+ *
+ * A stop can be reported before the coroutine gets the chance to park, and its SIGCHLD may
+ * already have been consumed. Checking here avoids missing such a state change entirely.
+ */
+bool TraceScheduler::StopAwaiter::await_ready() {
+    int status;
+    switch (scheduler_.tryReap(pid_, status)) {
+    case Reap::READY:
+        result_ = status;
+        return true;
+    case Reap::LOST:
+        return true;
+    case Reap::NONE:
+        return false;
+    }
+    return false;
+}
+
+void TraceScheduler::StopAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    scheduler_.park(this);
+}
+
+// --- ChildWatcher ---
+
+TraceScheduler::ChildWatcher::~ChildWatcher() {
+    if (signal_fd_ >= 0) close(signal_fd_);
+}
+
+bool TraceScheduler::ChildWatcher::Init() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, nullptr) == -1) {
+        PLOGE("set sigprocmask");
+        return false;
+    }
+    signal_fd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd_ == -1) {
+        PLOGE("create signalfd");
+        return false;
+    }
+    return true;
+}
+
+int TraceScheduler::ChildWatcher::GetFd() { return signal_fd_; }
+
+void TraceScheduler::ChildWatcher::HandleEvent(EventLoop &, uint32_t) {
+    struct signalfd_siginfo fdsi;
+    // Drain all queued notifications; a single Poll() covers every one of them.
+    while (read(signal_fd_, &fdsi, sizeof(fdsi)) == sizeof(fdsi)) {
+    }
+    scheduler_.Poll();
+}
+
+// --- TraceScheduler ---
+
+TraceScheduler::~TraceScheduler() {
+    if (timer_fd_ >= 0) close(timer_fd_);
+}
+
+bool TraceScheduler::Init() {
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd_ == -1) {
+        PLOGE("create timerfd");
+        return false;
+    }
+    return true;
+}
+
+int TraceScheduler::GetFd() { return timer_fd_; }
+
+/**
+ * @brief Expires every parked wait whose deadline has passed.
+ *
+ * The corresponding coroutines are resumed with `std::nullopt`; it is up to them to decide how
+ * to recover (typically by detaching and reporting failure).
+ */
+void TraceScheduler::HandleEvent(EventLoop &, uint32_t) {
+    uint64_t expirations;
+    if (read(timer_fd_, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+        PLOGE("read timerfd");
+    }
+
+    auto now = monotonic_ms();
+    std::vector<StopAwaiter *> expired;
+    for (auto *waiter : waiters_) {
+        if (waiter->deadline_ms_ <= now) {
+            LOGE("timed out waiting for PID %d to stop", waiter->pid_);
+            expired.push_back(waiter);
+        }
+    }
+    resume(expired);
+}
+
+void TraceScheduler::Spawn(Task<bool> task, std::function<void(bool)> on_done) {
+    auto &root = roots_.emplace_back(Root{std::move(task), std::move(on_done)});
+    root.task.start();
+    finishRoots();
+    armTimer();
+}
+
+void TraceScheduler::Poll() {
+    std::vector<StopAwaiter *> ready;
+    for (auto *waiter : waiters_) {
+        int status;
+        switch (tryReap(waiter->pid_, status)) {
+        case Reap::READY:
+            waiter->result_ = status;
+            ready.push_back(waiter);
+            break;
+        case Reap::LOST:
+            ready.push_back(waiter);
+            break;
+        case Reap::NONE:
+            break;
+        }
+    }
+    resume(ready);
+}
+
+/**
+ * @brief Performs a non-blocking wait on a single tracee.
+ *
+ * Seccomp stops are not interesting to tracing routines; the trapped syscall is skipped and the
+ * tracee continued, exactly like `wait_for_trace()` does for the blocking path.
+ */
+TraceScheduler::Reap TraceScheduler::tryReap(int pid, int &status) {
+    while (true) {
+        int ret = waitpid(pid, &status, __WALL | WNOHANG);
+        if (ret == 0) return Reap::NONE;
+        if (ret == -1) {
+            if (errno == EINTR) continue;
+            PLOGE("waitpid(%d)", pid);
+            return Reap::LOST;
+        }
+        if (is_seccomp_stop(status)) {
+            if (!tracee_skip_syscall(pid) || ptrace(PTRACE_CONT, pid, 0, 0) == -1) {
+                return Reap::LOST;
+            }
+            continue;
+        }
+        return Reap::READY;
+    }
+}
+
+void TraceScheduler::park(StopAwaiter *waiter) {
+    waiters_.push_back(waiter);
+    armTimer();
+}
+
+/**
+ * @brief Unparks and resumes the given waiters.
+ *
+ * Every waiter belongs to a different root task, so resuming one of them cannot invalidate
+ * another. A resumed coroutine may park again, which is why the waiters are removed first.
+ */
+void TraceScheduler::resume(std::vector<StopAwaiter *> &ready) {
+    if (ready.empty()) return;
+    std::erase_if(waiters_, [&ready](StopAwaiter *waiter) {
+        return std::find(ready.begin(), ready.end(), waiter) != ready.end();
+    });
+    for (auto *waiter : ready) {
+        waiter->handle_.resume();
+    }
+    finishRoots();
+    armTimer();
+}
+
+void TraceScheduler::armTimer() {
+    if (timer_fd_ < 0) return;
+
+    uint64_t deadline = UINT64_MAX;
+    for (auto *waiter : waiters_) deadline = std::min(deadline, waiter->deadline_ms_);
+
+    struct itimerspec spec{};  // All zeroes disarms the timer.
+    if (deadline != UINT64_MAX) {
+        spec.it_value.tv_sec = static_cast<time_t>(deadline / 1000);
+        spec.it_value.tv_nsec = static_cast<long>(deadline % 1000) * 1000000;
+    }
+    if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) == -1) {
+        PLOGE("arm timerfd");
+    }
+}
+
+void TraceScheduler::finishRoots() {
+    // Detach finished roots first: their callbacks are free to spawn new tasks.
+    std::list<Root> finished;
+    for (auto it = roots_.begin(); it != roots_.end();) {
+        auto next = std::next(it);
+        if (it->task.done()) finished.splice(finished.end(), roots_, it);
+        it = next;
+    }
+    for (auto &root : finished) {
+        if (root.on_done) root.on_done(root.task.result());
+    }
+}
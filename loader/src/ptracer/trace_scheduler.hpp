@@ -0,0 +1,122 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <coroutine>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <optional>
+#include <vector>
+
+#include "event_loop.hpp"
+#include "task.hpp"
+
+/**
+ * @brief Drives ptrace tracing coroutines from an EventLoop.
+ *
+ * Tracing a tracee is a sequence of "issue a ptrace request, then wait for the tracee to stop".
+ * Instead of blocking in `waitpid()` at every step, a tracing routine is written as a
+ * `Task<bool>` coroutine that suspends on `co_await scheduler.WaitStop(pid, timeout)`. The
+ * scheduler parks the coroutine and resumes it once the kernel reports a state change for that
+ * PID, or once the step's deadline expires.
+ *
+ * This turns every failure (a lost tracee, an unexpected stop, a step that never completes) into
+ * a `false` result of the corresponding task rather than a process-wide `exit()`.
+ *
+ * The scheduler itself is an EventHandler watching a `timerfd` armed for the earliest pending
+ * deadline. State changes are fed to it by `Poll()`, which performs a non-blocking `waitpid()`
+ * for every parked PID; the nested `ChildWatcher` calls it whenever a SIGCHLD arrives.
+ *
+ * It runs in the `trace` process the monitor execs for each zygote, not on the monitor's own
+ * loop. The remote calls of an injection run synchronously between two waits; on the monitor's
+ * loop they would hold up every process init forks or execs meanwhile, since those stay
+ * ptrace-stopped until the monitor handles them. A separate process also keeps a tracer that
+ * crashes or hangs from taking the monitor down with it.
+ */
+class TraceScheduler : public EventHandler {
+public:
+    /**
+     * @brief The awaitable returned by `WaitStop()`.
+     *
+     * Resumes with the raw wait status of the tracee, or `std::nullopt` if the step timed out or
+     * the tracee can no longer be waited for. Seccomp stops are handled transparently.
+     */
+    class StopAwaiter {
+    public:
+        StopAwaiter(TraceScheduler &scheduler, int pid, int timeout_ms);
+
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle);
+        std::optional<int> await_resume() const { return result_; }
+
+    private:
+        friend class TraceScheduler;
+
+        TraceScheduler &scheduler_;
+        int pid_;
+        uint64_t deadline_ms_;
+        std::optional<int> result_;
+        std::coroutine_handle<> handle_;
+    };
+
+    /**
+     * @brief Wakes the scheduler whenever the process receives SIGCHLD.
+     *
+     * Only needed when nothing else in the process reaps children; it blocks SIGCHLD and
+     * watches it through a `signalfd`.
+     */
+    class ChildWatcher : public EventHandler {
+    public:
+        explicit ChildWatcher(TraceScheduler &scheduler) : scheduler_(scheduler) {}
+        ~ChildWatcher() override;
+        bool Init();
+        int GetFd() override;
+        void HandleEvent(EventLoop &loop, uint32_t event) override;
+
+    private:
+        TraceScheduler &scheduler_;
+        int signal_fd_ = -1;
+    };
+
+    TraceScheduler() = default;
+    ~TraceScheduler() override;
+
+    TraceScheduler(const TraceScheduler &) = delete;
+    TraceScheduler &operator=(const TraceScheduler &) = delete;
+
+    bool Init();
+    int GetFd() override;
+    void HandleEvent(EventLoop &loop, uint32_t event) override;
+
+    /// Suspends the calling coroutine until `pid` enters a new wait state or `timeout_ms` passes.
+    /// A non-positive timeout waits indefinitely.
+    StopAwaiter WaitStop(int pid, int timeout_ms) { return {*this, pid, timeout_ms}; }
+
+    /// Starts a root task. `on_done` is invoked with its result once it finishes.
+    void Spawn(Task<bool> task, std::function<void(bool)> on_done);
+
+    /// Reaps pending state changes for every parked PID without blocking.
+    void Poll();
+
+    /// True when no root task is running.
+    bool Idle() const { return roots_.empty(); }
+
+private:
+    struct Root {
+        Task<bool> task;
+        std::function<void(bool)> on_done;
+    };
+
+    enum class Reap { NONE, READY, LOST };
+
+    Reap tryReap(int pid, int &status);
+    void park(StopAwaiter *waiter);
+    void resume(std::vector<StopAwaiter *> &ready);
+    void armTimer();
+    void finishRoots();
+
+    int timer_fd_ = -1;
+    std::vector<StopAwaiter *> waiters_;
+    std::list<Root> roots_;
+};
@@ -13,11 +13,14 @@ struct Status {
     bool zygote_injected = false;
     bool daemon_running = false;
     pid_t daemon_pid = -1;
+    // Milliseconds from spawning the daemon until it listened on its socket; -1 until then.
+    long daemon_ready_ms = -1;
     std::string daemon_info;
     std::string daemon_error_info;
+    // Step durations of the latest injection, as reported by the tracer.
+    std::string injection_timeline;
+    int injection_count = 0;
+    // The latest counters pushed by the daemon, one `key=value` per line.
+    std::string daemon_stats;
 };
 
-struct StartCounter {
-    struct timespec last_start_time{.tv_sec = 0, .tv_nsec = 0};
-    int count = 0;
-};
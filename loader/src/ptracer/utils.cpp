@@ -14,6 +14,7 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
 #include <cinttypes>
 #include <cstdio>
@@ -119,47 +120,88 @@ ssize_t read_proc(int pid, uintptr_t remote_addr, void *buf, size_t len) {
 
 // --- Register Manipulation (Architecture Specific) ---
 
-bool get_regs(int pid, struct user_regs_struct &regs) {
+#if defined(__aarch64__)
+// NT_PRSTATUS of an AArch32 tracee: r0-r15, cpsr, orig_r0.
+constexpr size_t COMPAT_NT_PRSTATUS_REGS = 18;
+// AArch32 has no architectural slot for orig_r0, so it is carried in an unused native register.
+constexpr size_t COMPAT_ORIG_R0_SLOT = 17;
+#elif defined(__x86_64__)
+// Code segment selector of 32-bit user mode (__USER32_CS).
+constexpr unsigned long X86_USER32_CS = 0x23;
+#endif
+
+bool get_regs(int pid, RemoteRegs &regs) {
 #if defined(__x86_64__) || defined(__i386__)
-    if (ptrace(PTRACE_GETREGS, pid, 0, &regs) == -1) {
+    if (ptrace(PTRACE_GETREGS, pid, 0, &regs.raw) == -1) {
         PLOGE("ptrace(PTRACE_GETREGS)");
         return false;
     }
-#elif defined(__aarch64__) || defined(__arm__)
-    struct iovec iov = {.iov_base = &regs, .iov_len = sizeof(regs)};
+#if defined(__x86_64__)
+    // A 64-bit tracer always gets the 64-bit layout; only the code segment tells the ABI apart.
+    regs.compat = regs.raw.cs == X86_USER32_CS;
+#endif
+#elif defined(__aarch64__)
+    // The kernel picks the regset layout from the tracee's ABI, and reports its size.
+    union {
+        struct user_regs_struct native;
+        uint32_t compat[COMPAT_NT_PRSTATUS_REGS];
+    } buf{};
+    struct iovec iov = {.iov_base = &buf, .iov_len = sizeof(buf)};
+    if (ptrace(PTRACE_GETREGSET, pid, NT_PRSTATUS, &iov) == -1) {
+        PLOGE("ptrace(PTRACE_GETREGSET)");
+        return false;
+    }
+    regs.compat = iov.iov_len == sizeof(buf.compat);
+    if (regs.compat) {
+        regs.raw = {};
+        for (size_t i = 0; i < 15; i++) regs.raw.regs[i] = buf.compat[i];
+        regs.raw.pc = buf.compat[15];
+        regs.raw.pstate = buf.compat[16];
+        regs.raw.regs[COMPAT_ORIG_R0_SLOT] = buf.compat[17];
+    } else {
+        regs.raw = buf.native;
+    }
+#elif defined(__arm__)
+    struct iovec iov = {.iov_base = &regs.raw, .iov_len = sizeof(regs.raw)};
     if (ptrace(PTRACE_GETREGSET, pid, NT_PRSTATUS, &iov) == -1) {
         PLOGE("ptrace(PTRACE_GETREGSET)");
-#if defined(__arm__)
-        if (ptrace(PTRACE_GETREGS, pid, 0, &regs) == -1) {
+        if (ptrace(PTRACE_GETREGS, pid, 0, &regs.raw) == -1) {
             PLOGE("fallback to PTRACE_GETREGS");
             return false;
         }
-#else
-        return false;
-#endif
     }
 #endif
     return true;
 }
 
-bool set_regs(int pid, struct user_regs_struct &regs) {
+bool set_regs(int pid, RemoteRegs &regs) {
 #if defined(__x86_64__) || defined(__i386__)
-    if (ptrace(PTRACE_SETREGS, pid, 0, &regs) == -1) {
+    if (ptrace(PTRACE_SETREGS, pid, 0, &regs.raw) == -1) {
         PLOGE("ptrace(PTRACE_SETREGS)");
         return false;
     }
-#elif defined(__aarch64__) || defined(__arm__)
-    struct iovec iov = {.iov_base = &regs, .iov_len = sizeof(regs)};
+#elif defined(__aarch64__)
+    uint32_t compat[COMPAT_NT_PRSTATUS_REGS];
+    struct iovec iov = {.iov_base = &regs.raw, .iov_len = sizeof(regs.raw)};
+    if (regs.compat) {
+        for (size_t i = 0; i < 15; i++) compat[i] = static_cast<uint32_t>(regs.raw.regs[i]);
+        compat[15] = static_cast<uint32_t>(regs.raw.pc);
+        compat[16] = static_cast<uint32_t>(regs.raw.pstate);
+        compat[17] = static_cast<uint32_t>(regs.raw.regs[COMPAT_ORIG_R0_SLOT]);
+        iov = {.iov_base = compat, .iov_len = sizeof(compat)};
+    }
     if (ptrace(PTRACE_SETREGSET, pid, NT_PRSTATUS, &iov) == -1) {
         PLOGE("ptrace(PTRACE_SETREGSET)");
-#if defined(__arm__)
-        if (ptrace(PTRACE_SETREGS, pid, 0, &regs) == -1) {
+        return false;
+    }
+#elif defined(__arm__)
+    struct iovec iov = {.iov_base = &regs.raw, .iov_len = sizeof(regs.raw)};
+    if (ptrace(PTRACE_SETREGSET, pid, NT_PRSTATUS, &iov) == -1) {
+        PLOGE("ptrace(PTRACE_SETREGSET)");
+        if (ptrace(PTRACE_SETREGS, pid, 0, &regs.raw) == -1) {
             PLOGE("fallback to PTRACE_SETREGS");
             return false;
         }
-#else
-        return false;
-#endif
     }
 #endif
     return true;
@@ -255,147 +297,232 @@ void *find_func_addr(const std::vector<MapInfo> &local_info,
     return (void *) remote_addr;
 }
 
-// --- Remote Call Implementation ---
+namespace {
 
-// Most ABIs require the stack to be 16-byte aligned.
-constexpr uintptr_t STACK_ALIGN_MASK = ~0xf;
+struct Elf32Types {
+    using Ehdr = Elf32_Ehdr;
+    using Phdr = Elf32_Phdr;
+    using Shdr = Elf32_Shdr;
+    using Sym = Elf32_Sym;
+};
 
-void align_stack(struct user_regs_struct &regs, long preserve) {
-    regs.REG_SP = (regs.REG_SP - preserve) & STACK_ALIGN_MASK;
-}
+struct Elf64Types {
+    using Ehdr = Elf64_Ehdr;
+    using Phdr = Elf64_Phdr;
+    using Shdr = Elf64_Shdr;
+    using Sym = Elf64_Sym;
+};
 
 /**
- * @brief Pushes a string onto the remote process's stack.
- * @return The address of the string in the remote process, or 0 on failure.
+ * @brief Looks up a defined dynamic symbol in an ELF file mapped in memory.
+ * @return The symbol's offset from the start of the module's first mapping, or 0.
  */
-uintptr_t push_string(int pid, struct user_regs_struct &regs, const char *str) {
-    size_t len = strlen(str) + 1;
-    regs.REG_SP -= len;
-    align_stack(regs);  // Re-align after subtracting length.
-
-    uintptr_t remote_addr = regs.REG_SP;
-    if (write_proc(pid, remote_addr, str, len) != static_cast<ssize_t>(len)) {
-        LOGE("failed to write string '%s' to remote process", str);
-        return 0;  // Return 0 on failure.
-    }
-    LOGV("pushed string \"%s\" to 0x%" PRIxPTR, str, remote_addr);
-    return remote_addr;
+template <typename Elf>
+uintptr_t find_file_symbol_offset(const uint8_t *file, size_t size, std::string_view name) {
+    auto ehdr = reinterpret_cast<const typename Elf::Ehdr *>(file);
+    if (ehdr->e_phoff + ehdr->e_phnum * sizeof(typename Elf::Phdr) > size ||
+        ehdr->e_shoff + ehdr->e_shnum * sizeof(typename Elf::Shdr) > size) {
+        return 0;
+    }
+
+    // The first mapping of a module (the one find_module_base() reports) maps offset 0, which
+    // lies at `p_vaddr - p_offset` of the first PT_LOAD.
+    auto phdrs = reinterpret_cast<const typename Elf::Phdr *>(file + ehdr->e_phoff);
+    uintptr_t bias = 0;
+    for (size_t i = 0; i < ehdr->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD) {
+            bias = phdrs[i].p_vaddr - phdrs[i].p_offset;
+            break;
+        }
+    }
+
+    auto shdrs = reinterpret_cast<const typename Elf::Shdr *>(file + ehdr->e_shoff);
+    for (size_t i = 0; i < ehdr->e_shnum; i++) {
+        const auto &symtab = shdrs[i];
+        if (symtab.sh_type != SHT_DYNSYM || symtab.sh_link >= ehdr->e_shnum) continue;
+        const auto &strtab = shdrs[symtab.sh_link];
+        if (symtab.sh_offset + symtab.sh_size > size || strtab.sh_offset + strtab.sh_size > size) {
+            return 0;
+        }
+        auto syms = reinterpret_cast<const typename Elf::Sym *>(file + symtab.sh_offset);
+        auto strs = reinterpret_cast<const char *>(file + strtab.sh_offset);
+        size_t count = symtab.sh_size / sizeof(typename Elf::Sym);
+        for (size_t j = 0; j < count; j++) {
+            if (syms[j].st_shndx == SHN_UNDEF || syms[j].st_name >= strtab.sh_size) continue;
+            if (name == strs + syms[j].st_name) return syms[j].st_value - bias;
+        }
+    }
+    return 0;
 }
 
+}  // namespace
+
 /**
- * @brief Executes a function in the remote process.
+ * @brief Calculates the address of a function in a remote process from the module's file.
  *
- * This function is highly architecture-specific. It works by:
- * 1.  Setting up the remote process's registers according to the platform's C calling convention
- * (ABI).
- * 2.  Pushing arguments onto the remote stack if necessary.
- * 3.  Setting the return address register/stack to a specific `return_addr` (usually a
- * non-executable address).
- * 4.  Setting the instruction pointer to the `func_addr`.
- * 5.  Continuing the process, which executes the function.
- * 6.  Waiting for the process to trap (usually via SIGSEGV at our fake return address).
- * 7.  Reading the function's return value from the appropriate register.
- *
- * @return The return value of the remote function, or 0 on failure.
+ * The module is located in the remote maps, and its file is read to find the symbol in the
+ * dynamic symbol table. Both ELF classes are supported, whatever the class of this process.
+ * remote_sym = remote_base + (st_value - first_mapping_vaddr)
  */
-uintptr_t remote_call(int pid, struct user_regs_struct &regs, uintptr_t func_addr,
-                      uintptr_t return_addr, std::vector<long> &args) {
-    align_stack(regs);
-    LOGV("calling remote function 0x%" PRIxPTR " with %zu args, return to 0x%" PRIxPTR, func_addr,
-         args.size(), return_addr);
-
-#if defined(__x86_64__)
-    // ABI: rdi, rsi, rdx, rcx, r8, r9, then stack
-    if (args.size() > 0) regs.rdi = args[0];
-    if (args.size() > 1) regs.rsi = args[1];
-    if (args.size() > 2) regs.rdx = args[2];
-    if (args.size() > 3) regs.rcx = args[3];
-    if (args.size() > 4) regs.r8 = args[4];
-    if (args.size() > 5) regs.r9 = args[5];
-    if (args.size() > 6) {
-        size_t stack_args_size = (args.size() - 6) * sizeof(long);
-        regs.REG_SP -= stack_args_size;
-        if (write_proc(pid, regs.REG_SP, args.data() + 6, stack_args_size) !=
-            (ssize_t) stack_args_size) {
-            LOGE("failed to push stack arguments for x86_64 call");
-            return 0;
+void *find_func_addr_from_file(const std::vector<MapInfo> &remote_info, std::string_view module,
+                               std::string_view func) {
+    const MapInfo *base_map = nullptr;
+    for (const auto &map : remote_info) {
+        if (map.offset == 0 && map.path.ends_with(module)) {
+            base_map = &map;
+            break;
         }
     }
-    // Push return address
-    regs.REG_SP -= sizeof(long);
-    if (write_proc(pid, regs.REG_SP, &return_addr, sizeof(return_addr)) != sizeof(return_addr)) {
-        LOGE("failed to push return address for x86_64 call");
-        return 0;
+    if (base_map == nullptr) {
+        LOGE("failed to find remote base for module %s", module.data());
+        return nullptr;
     }
-    regs.REG_IP = func_addr;
-
-#elif defined(__i386__)
-    // ABI: All arguments on stack, pushed in reverse order.
-    // Our vector is already in the correct order to write in one block.
-    if (!args.empty()) {
-        size_t stack_args_size = args.size() * sizeof(long);
-        regs.REG_SP -= stack_args_size;
-        if (write_proc(pid, regs.REG_SP, args.data(), stack_args_size) !=
-            (ssize_t) stack_args_size) {
-            LOGE("failed to push arguments for i386 call");
-            return 0;
-        }
+
+    int fd = open(base_map->path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        PLOGE("open %s", base_map->path.c_str());
+        return nullptr;
     }
-    // Push return address
-    regs.REG_SP -= sizeof(long);
-    if (write_proc(pid, regs.REG_SP, &return_addr, sizeof(return_addr)) != sizeof(return_addr)) {
-        LOGE("failed to write return addr for i386 call");
-        return 0;
+    struct stat st{};
+    void *file = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Elf64_Ehdr)) {
+        file = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (file == MAP_FAILED) {
+        LOGE("failed to map %s", base_map->path.c_str());
+        return nullptr;
     }
-    regs.REG_IP = func_addr;
 
-#elif defined(__aarch64__)
-    // ABI: x0-x7, then stack
-    for (size_t i = 0; i < args.size() && i < 8; i++) {
-        regs.regs[i] = args[i];
-    }
-    if (args.size() > 8) {
-        size_t stack_args_size = (args.size() - 8) * sizeof(long);
-        regs.REG_SP -= stack_args_size;
-        if (write_proc(pid, regs.REG_SP, args.data() + 8, stack_args_size) !=
-            (ssize_t) stack_args_size) {
-            LOGE("failed to push stack arguments for aarch64 call");
-            return 0;
+    auto bytes = static_cast<const uint8_t *>(file);
+    size_t size = st.st_size;
+    uintptr_t offset = 0;
+    if (memcmp(bytes, ELFMAG, SELFMAG) == 0) {
+        if (bytes[EI_CLASS] == ELFCLASS32) {
+            offset = find_file_symbol_offset<Elf32Types>(bytes, size, func);
+        } else if (bytes[EI_CLASS] == ELFCLASS64) {
+            offset = find_file_symbol_offset<Elf64Types>(bytes, size, func);
         }
     }
-    regs.regs[30] = return_addr;  // Link Register (LR)
-    regs.REG_IP = func_addr;
+    munmap(file, size);
+    if (offset == 0) {
+        LOGE("failed to find sym %s in %s", func.data(), base_map->path.c_str());
+        return nullptr;
+    }
 
-#elif defined(__arm__)
-    // ABI: r0-r3, then stack
-    for (size_t i = 0; i < args.size() && i < 4; i++) {
-        regs.uregs[i] = args[i];
-    }
-    if (args.size() > 4) {
-        size_t stack_args_size = (args.size() - 4) * sizeof(long);
-        regs.REG_SP -= stack_args_size;
-        if (write_proc(pid, (uintptr_t) regs.REG_SP, args.data() + 4, stack_args_size) !=
-            (ssize_t) stack_args_size) {
-            LOGE("failed to push stack arguments for arm call");
-            return 0;
+    uintptr_t remote_addr = base_map->start + offset;
+    LOGV("found remote %s!%s at 0x%" PRIxPTR " from its file", module.data(), func.data(),
+         remote_addr);
+    return (void *) remote_addr;
+}
+
+bool is_compat_process(int pid) {
+#if defined(__LP64__)
+    std::string path = "/proc/" + std::to_string(pid) + "/exe";
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        PLOGE("open %s", path.c_str());
+        return false;
+    }
+    unsigned char ident[EI_NIDENT];
+    bool compat = read(fd, ident, sizeof(ident)) == sizeof(ident) &&
+                  memcmp(ident, ELFMAG, SELFMAG) == 0 && ident[EI_CLASS] == ELFCLASS32;
+    close(fd);
+    return compat;
+#else
+    (void) pid;
+    return false;
+#endif
+}
+
+// --- Remote Call Implementation ---
+
+// Most ABIs require the stack to be 16-byte aligned.
+constexpr uintptr_t STACK_ALIGN_MASK = ~0xf;
+
+void align_stack(RemoteRegs &regs, long preserve) {
+    regs.sp() = (regs.sp() - preserve) & STACK_ALIGN_MASK;
+}
+
+/**
+ * @brief Executes a function in the remote process whose register arguments are already set.
+ *
+ * This is the non-template back end of `remote_invoke()`. By the time it is called, every
+ * argument passed in a register has been placed into `regs` by the caller; only the
+ * stack-passed ones are left. It works by:
+ * 1.  Aligning the stack and writing the stack arguments, together with the return address on
+ *     x86, in a single remote write. Each slot is a word of the tracee's ABI, so arguments are
+ *     narrowed to 32 bits for a compat tracee.
+ * 2.  Setting the return address register (on ARM) to `return_addr`, which is usually a
+ *     non-executable address.
+ * 3.  Setting the instruction pointer to the `func_addr`.
+ * 4.  Continuing the process, which executes the function.
+ * 5.  Waiting for the process to trap (usually via SIGSEGV at our fake return address).
+ * 6.  Reading the function's return value from the appropriate register.
+ *
+ * @return The return value of the remote function, or 0 on failure.
+ */
+uintptr_t remote_call_prepared(int pid, RemoteRegs &regs, uintptr_t func_addr,
+                               uintptr_t return_addr, const long *stack_args,
+                               size_t stack_count) {
+    LOGV("calling remote function 0x%" PRIxPTR " with %zu stack args, return to 0x%" PRIxPTR,
+         func_addr, stack_count, return_addr);
+
+    const size_t word = regs.word_size();
+    uint8_t block[(REMOTE_MAX_STACK_ARGS + 1) * sizeof(long)];
+    size_t block_size = 0;
+    auto push_word = [&](long value) {
+        if (word == sizeof(uint32_t)) {
+            auto narrow = static_cast<uint32_t>(value);
+            memcpy(block + block_size, &narrow, sizeof(narrow));
+        } else {
+            memcpy(block + block_size, &value, sizeof(value));
         }
+        block_size += word;
+    };
+
+#if defined(__x86_64__) || defined(__i386__)
+    // The return address sits right below the arguments, exactly as a `call` would push it.
+    push_word(static_cast<long>(return_addr));
+#endif
+    for (size_t i = 0; i < stack_count; i++) push_word(stack_args[i]);
+
+    // The stack arguments start at a 16-byte aligned address, as most ABIs require at call sites.
+    size_t args_size = stack_count * word;
+    auto &sp = regs.sp();
+    sp = ((sp - args_size) & STACK_ALIGN_MASK) - (block_size - args_size);
+    if (block_size > 0 && write_proc(pid, sp, block, block_size) != (ssize_t) block_size) {
+        LOGE("failed to push return address and stack arguments for remote call");
+        return 0;
     }
-    regs.uregs[14] = return_addr;  // Link Register (LR)
-    regs.REG_IP = func_addr;       // Program Counter (PC)
+    regs.ip() = func_addr;
+
+#if defined(__aarch64__) || defined(__arm__)
+#if defined(__aarch64__)
+    const bool aarch32 = regs.compat;
+    auto &lr = regs.compat ? regs.raw.regs[14] : regs.raw.regs[30];
+    auto &cpsr = regs.raw.pstate;
+#else
+    const bool aarch32 = true;
+    auto &lr = regs.raw.uregs[14];
+    auto &cpsr = regs.raw.uregs[16];
+#endif
+    lr = return_addr;  // Link Register (LR)
 
     // Handle Thumb vs ARM mode. The lowest bit of an address indicates Thumb mode.
     // The PC register itself must not have this bit set. It's stored in the CPSR.
     constexpr auto CPSR_T_MASK = 1lu << 5;
-    if ((regs.REG_IP & 1) != 0) {
-        // Thumb mode: remove LSB from PC and set T-bit in CPSR
-        regs.REG_IP &= ~1;
-        regs.uregs[16] |= CPSR_T_MASK;
-    } else {
-        // ARM mode: clear T-bit in CPSR
-        regs.uregs[16] &= ~CPSR_T_MASK;
+    if (aarch32) {
+        if ((regs.ip() & 1) != 0) {
+            // Thumb mode: remove LSB from PC and set T-bit in CPSR
+            regs.ip() &= ~1;
+            cpsr |= CPSR_T_MASK;
+        } else {
+            // ARM mode: clear T-bit in CPSR
+            cpsr &= ~CPSR_T_MASK;
+        }
     }
-
-#else
+#elif !defined(__x86_64__) && !defined(__i386__)
 #error "Unsupported architecture for remote_call"
 #endif
 
@@ -404,9 +531,16 @@ uintptr_t remote_call(int pid, struct user_regs_struct &regs, uintptr_t func_add
         return 0;
     }
 
-    ptrace(PTRACE_CONT, pid, 0, 0);
+    if (ptrace(PTRACE_CONT, pid, 0, 0) == -1) {
+        PLOGE("remote_call: ptrace(PTRACE_CONT)");
+        return 0;
+    }
     int status;
-    wait_for_trace(pid, &status, __WALL);  // wait_for_trace handles intermediate stops
+    // wait_for_trace handles intermediate stops
+    if (!wait_for_trace(pid, &status, __WALL)) {
+        LOGE("remote_call: tracee %d was lost during the call", pid);
+        return 0;
+    }
 
     if (!get_regs(pid, regs)) {
         LOGE("remote_call: failed to get registers after call");
@@ -414,17 +548,102 @@ uintptr_t remote_call(int pid, struct user_regs_struct &regs, uintptr_t func_add
     }
 
     // We expect the tracee to stop at our fake return address.
-    if (WIFSTOPPED(status) && static_cast<uintptr_t>(regs.REG_IP) == return_addr) {
-        LOGV("remote call returned, result: 0x%" PRIXPTR, (uintptr_t) regs.REG_RET);
-        return regs.REG_RET;
+    if (WIFSTOPPED(status) && static_cast<uintptr_t>(regs.ip()) == return_addr) {
+        uintptr_t result = regs.ret();
+        if (regs.compat) result = static_cast<uint32_t>(result);
+        LOGV("remote call returned, result: 0x%" PRIXPTR, result);
+        return result;
     } else {
         LOGE("process stopped unexpectedly after remote call: %s at ip=0x%" PRIXPTR
              ", expected stop at 0x%" PRIXPTR,
-             parse_status(status).c_str(), (uintptr_t) regs.REG_IP, return_addr);
+             parse_status(status).c_str(), (uintptr_t) regs.ip(), return_addr);
         return 0;
     }
 }
 
+/**
+ * @brief Executes a function in the remote process with a runtime-sized argument list.
+ *
+ * Kept for callers that build their arguments dynamically, and used by `remote_invoke()` for
+ * compat tracees; it performs the same placement, only decided at runtime.
+ *
+ * @return The return value of the remote function, or 0 on failure.
+ */
+uintptr_t remote_call(int pid, RemoteRegs &regs, uintptr_t func_addr, uintptr_t return_addr,
+                      const std::vector<long> &args) {
+    size_t reg_count = std::min(args.size(), regs.compat ? COMPAT_REG_ARGS : REMOTE_REG_ARGS);
+    size_t stack_count = args.size() - reg_count;
+    if (stack_count > REMOTE_MAX_STACK_ARGS) {
+        LOGE("remote_call: too many arguments (%zu)", args.size());
+        return 0;
+    }
+    for (size_t i = 0; i < reg_count; i++) {
+        set_arg_reg(regs, i, args[i]);
+    }
+    return remote_call_prepared(pid, regs, func_addr, return_addr, args.data() + reg_count,
+                                stack_count);
+}
+
+// --- Remote Arena ---
+
+bool RemoteArena::Map(int pid, RemoteRegs &regs, uintptr_t mmap_addr, uintptr_t return_addr,
+                      size_t size) {
+    auto addr = remote_invoke<uintptr_t>(pid, regs, mmap_addr, return_addr, nullptr, size,
+                                         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+                                         0);
+    auto map_failed = regs.compat ? UINT32_MAX : (uintptr_t) MAP_FAILED;
+    if (addr == 0 || addr == map_failed) {
+        LOGE("remote mmap of %zu bytes failed", size);
+        return false;
+    }
+    pid_ = pid;
+    base_ = addr;
+    local_.assign(size, 0);
+    used_ = flushed_ = 0;
+    LOGV("mapped remote arena of %zu bytes at 0x%" PRIxPTR, size, base_);
+    return true;
+}
+
+uintptr_t RemoteArena::Stage(const void *data, size_t len, size_t align) {
+    size_t offset = (used_ + align - 1) & ~(align - 1);
+    if (base_ == 0 || offset + len > local_.size()) {
+        LOGE("remote arena exhausted: need %zu bytes at offset %zu of %zu", len, offset,
+             local_.size());
+        return 0;
+    }
+    memcpy(local_.data() + offset, data, len);
+    used_ = offset + len;
+    return base_ + offset;
+}
+
+uintptr_t RemoteArena::StageString(std::string_view str) {
+    auto addr = Stage(str.data(), str.size() + 1, 1);
+    if (addr != 0) local_[addr - base_ + str.size()] = '\0';
+    return addr;
+}
+
+bool RemoteArena::Flush() {
+    if (used_ == flushed_) return true;
+    size_t len = used_ - flushed_;
+    if (write_proc(pid_, base_ + flushed_, local_.data() + flushed_, len) !=
+        static_cast<ssize_t>(len)) {
+        LOGE("failed to write %zu bytes to remote arena", len);
+        return false;
+    }
+    flushed_ = used_;
+    return true;
+}
+
+void RemoteArena::Unmap(RemoteRegs &regs, uintptr_t munmap_addr, uintptr_t return_addr) {
+    if (base_ == 0) return;
+    // munmap returns 0 on success, which remote_call cannot tell apart from a failed call,
+    // so the result is not checked.
+    remote_invoke<void>(pid_, regs, munmap_addr, return_addr, base_, local_.size());
+    base_ = 0;
+    local_.clear();
+    used_ = flushed_ = 0;
+}
+
 // --- Process Management ---
 
 /**
@@ -497,21 +716,22 @@ s
  * work on all kernel versions, so their errors are ignored.
  *
  * @param pid The process ID of the tracee.
+ * @return True if the syscall number was rewritten, false otherwise.
  */
-void tracee_skip_syscall(int pid) {
-    user_regs_struct regs;
+bool tracee_skip_syscall(int pid) {
+    RemoteRegs regs;
     if (!get_regs(pid, regs)) {
         LOGE("tracee_skip_syscall: failed to get registers");
-        exit(1);
+        return false;
     }
 
     // Set the syscall number to an invalid value (-1).
     // The kernel will see this and skip the syscall execution.
-    regs.REG_SYSNR = -1;
+    regs.sysnr() = -1;
 
     if (!set_regs(pid, regs)) {
         LOGE("tracee_skip_syscall: failed to set registers to skip syscall");
-        exit(1);
+        return false;
     }
 
     // For ARM architectures, there are specific ptrace requests to modify the
@@ -525,6 +745,7 @@ void tracee_skip_syscall(int pid) {
 #elif defined(__arm__)
     ptrace(PTRACE_SET_SYSCALL, pid, 0, (void *) -1);
 #endif
+    return true;
 }
 
 /**
@@ -533,23 +754,27 @@ void tracee_skip_syscall(int pid) {
  * This is a wrapper around waitpid that handles EINTR and automatically
  * continues the process after a PTRACE_EVENT_SECCOMP.
  *
+ * Failures are reported to the caller instead of terminating the tracer, so that a
+ * misbehaving tracee only aborts its own injection.
+ *
  * @param pid The PID to wait for.
  * @param status A pointer to an integer where the status will be stored.
  * @param flags Flags for waitpid.
+ * @return True if the tracee entered a ptrace-stop, false if waiting failed or it terminated.
  */
-void wait_for_trace(int pid, int *status, int flags) {
+bool wait_for_trace(int pid, int *status, int flags) {
     while (true) {
         if (waitpid(pid, status, flags) == -1) {
             if (errno == EINTR) {
                 continue;  // Interrupted by a signal, just retry.
             }
             PLOGE("waitpid(%d)", pid);
-            exit(1);
+            return false;
         }
 
         // Check if the stop was caused by a PTRACE_EVENT_SECCOMP.
-        if (*status >> 8 == (SIGTRAP | (PTRACE_EVENT_SECCOMP << 8))) {
-            tracee_skip_syscall(pid);
+        if (is_seccomp_stop(*status)) {
+            if (!tracee_skip_syscall(pid)) return false;
             ptrace(PTRACE_CONT, pid, 0, 0);
             continue;  // Continue waiting for the next *real* stop event.
         }
@@ -557,11 +782,11 @@ void wait_for_trace(int pid, int *status, int flags) {
         // If the process terminated or signaled instead of stopping, it's an error.
         if (!WIFSTOPPED(*status)) {
             LOGE("process %d did not stop as expected: %s", pid, parse_status(*status).c_str());
-            exit(1);
+            return false;
         }
 
         // It's a valid stop event that we need to handle, so we return.
-        return;
+        return true;
     }
 }
 
@@ -582,22 +807,3 @@ std::string parse_status(int status) {
     }
     return os.str();
 }
-
-/**
- * @brief Gets the executable path of a process from /proc/[pid]/exe.
- * @return The path to the executable, or an empty string on failure.
- */
-std::string get_program(int pid) {
-    std::string path = "/proc/";
-    path += std::to_string(pid);
-    path += "/exe";
-    constexpr const auto SIZE = 256;
-    char buf[SIZE + 1];
-    auto sz = readlink(path.c_str(), buf, SIZE);
-    if (sz == -1) {
-        PLOGE("readlink /proc/%d/exe", pid);
-        return "";
-    }
-    buf[sz] = 0;
-    return buf;
-}
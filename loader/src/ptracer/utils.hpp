@@ -1,8 +1,12 @@
 #pragma once
+#include <signal.h>
 #include <sys/ptrace.h>
 
 #include <cstdint>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 struct MapInfo {
@@ -57,13 +61,49 @@ struct MapInfo {
 #define user_regs_struct user_regs
 #endif
 
+/**
+ * @brief The registers of a tracee, and the ABI it runs in.
+ *
+ * A 64-bit tracer may trace a 32-bit (compat) process. Its registers are then widened into the
+ * native `user_regs_struct`, at the slots the kernel itself uses for them: on AArch64, r0-r14 are
+ * x0-x14, r15 is `pc` and the CPSR is `pstate`; on x86-64, the i386 registers are the lower
+ * halves of their 64-bit counterparts. The instruction pointer and the return value therefore
+ * live in the same place for both ABIs, while the stack pointer, the link register and the
+ * syscall number are reached through the accessors below.
+ */
+struct RemoteRegs {
+    struct user_regs_struct raw{};
+    /// True for a 32-bit tracee of a 64-bit tracer.
+    bool compat = false;
+
+    /// Size of a pointer, and of a stack slot, in the tracee.
+    size_t word_size() const { return compat ? sizeof(uint32_t) : sizeof(uintptr_t); }
+
+    auto &ip() { return raw.REG_IP; }
+    auto &ret() { return raw.REG_RET; }
+    auto &sp() {
+#if defined(__aarch64__)
+        return compat ? raw.regs[13] : raw.REG_SP;
+#else
+        return raw.REG_SP;
+#endif
+    }
+    auto &sysnr() {
+#if defined(__aarch64__)
+        return compat ? raw.regs[7] : raw.REG_SYSNR;
+#else
+        return raw.REG_SYSNR;
+#endif
+    }
+};
+
 ssize_t write_proc(int pid, uintptr_t remote_addr, const void *buf, size_t len);
 
 ssize_t read_proc(int pid, uintptr_t remote_addr, void *buf, size_t len);
 
-bool get_regs(int pid, struct user_regs_struct &regs);
+bool get_regs(int pid, RemoteRegs &regs);
 
-bool set_regs(int pid, struct user_regs_struct &regs);
+bool set_regs(int pid, RemoteRegs &regs);
 
 std::string get_addr_mem_region(std::vector<MapInfo> &info, uintptr_t addr);
 
@@ -73,21 +113,198 @@ void *find_func_addr(const std::vector<MapInfo> &local_info,
                      const std::vector<MapInfo> &remote_info, std::string_view module,
                      std::string_view func);
 
-void align_stack(struct user_regs_struct &regs, long preserve = 0);
+/**
+ * @brief Resolves `module!func` in another process from the module's ELF file.
+ *
+ * Unlike `find_func_addr`, this does not load the module locally, so it also works for a
+ * compat tracee whose libraries cannot be opened by this process.
+ */
+void *find_func_addr_from_file(const std::vector<MapInfo> &remote_info, std::string_view module,
+                               std::string_view func);
+
+/// True if `pid` runs a 32-bit executable while this tracer is 64-bit.
+bool is_compat_process(int pid);
+
+void align_stack(RemoteRegs &regs, long preserve = 0);
+
+// --- Remote Calls ---
+
+// Number of integer/pointer arguments passed in registers by the native C calling convention.
+#if defined(__x86_64__)
+constexpr size_t REMOTE_REG_ARGS = 6;  // rdi, rsi, rdx, rcx, r8, r9
+#elif defined(__i386__)
+constexpr size_t REMOTE_REG_ARGS = 0;  // cdecl: everything on the stack
+#elif defined(__aarch64__)
+constexpr size_t REMOTE_REG_ARGS = 8;  // x0-x7
+#elif defined(__arm__)
+constexpr size_t REMOTE_REG_ARGS = 4;  // r0-r3
+#endif
+
+// The same for a compat tracee: i386 cdecl passes everything on the stack, AAPCS32 uses r0-r3.
+#if defined(__aarch64__)
+constexpr size_t COMPAT_REG_ARGS = 4;
+#else
+constexpr size_t COMPAT_REG_ARGS = 0;
+#endif
 
-uintptr_t push_string(int pid, struct user_regs_struct &regs, const char *str);
+// Upper bound for stack-passed arguments, so that they can be written from a fixed buffer.
+constexpr size_t REMOTE_MAX_STACK_ARGS = 8;
 
-uintptr_t remote_call(int pid, struct user_regs_struct &regs, uintptr_t func_addr,
-                      uintptr_t return_addr, std::vector<long> &args);
+/// Stores argument `index` (which must be < REMOTE_REG_ARGS) in its argument register.
+/// For a compat tracee, the index must be < COMPAT_REG_ARGS instead.
+inline void set_arg_reg(RemoteRegs &regs, size_t index, long value) {
+#if defined(__x86_64__)
+    switch (index) {
+    case 0:
+        regs.raw.rdi = value;
+        break;
+    case 1:
+        regs.raw.rsi = value;
+        break;
+    case 2:
+        regs.raw.rdx = value;
+        break;
+    case 3:
+        regs.raw.rcx = value;
+        break;
+    case 4:
+        regs.raw.r8 = value;
+        break;
+    case 5:
+        regs.raw.r9 = value;
+        break;
+    }
+#elif defined(__aarch64__)
+    regs.raw.regs[index] = value;
+#elif defined(__arm__)
+    regs.raw.uregs[index] = value;
+#else
+    (void) regs, (void) index, (void) value;
+#endif
+}
+
+/// Converts a pointer, integer or enum argument to a machine word of the native ABI.
+template <typename T>
+inline long to_remote_word(T value) {
+    if constexpr (std::is_pointer_v<T> || std::is_null_pointer_v<T>) {
+        return static_cast<long>(reinterpret_cast<uintptr_t>(value));
+    } else {
+        static_assert(std::is_integral_v<T> || std::is_enum_v<T>,
+                      "remote arguments must be pointers, integers or enums");
+        return static_cast<long>(value);
+    }
+}
+
+/// Places argument `I` in its register, or in its slot of the stack argument block.
+template <size_t REG_COUNT, size_t I>
+inline void place_remote_arg(RemoteRegs &regs, long *stack, long word) {
+    if constexpr (I < REG_COUNT) {
+        set_arg_reg(regs, I, word);
+    } else {
+        stack[I - REG_COUNT] = word;
+    }
+}
+
+uintptr_t remote_call_prepared(int pid, RemoteRegs &regs, uintptr_t func_addr,
+                               uintptr_t return_addr, const long *stack_args, size_t stack_count);
+
+uintptr_t remote_call(int pid, RemoteRegs &regs, uintptr_t func_addr, uintptr_t return_addr,
+                      const std::vector<long> &args);
+
+/**
+ * @brief Calls `func_addr(args...)` in the tracee and returns its result as `Ret`.
+ *
+ * Which arguments go to registers and which to the stack is decided at compile time for the
+ * native ABI, so no argument vector is built; all stack arguments are written with a single
+ * remote write. A compat tracee takes the runtime placement of `remote_call` instead. `Ret` may
+ * be `void`, an integer, or a pointer type. Like `remote_call`, a failed call yields a zero
+ * result.
+ */
+template <typename Ret = uintptr_t, typename... Args>
+Ret remote_invoke(int pid, RemoteRegs &regs, uintptr_t func_addr, uintptr_t return_addr,
+                  Args... args) {
+    constexpr size_t ARG_COUNT = sizeof...(Args);
+    constexpr size_t REG_COUNT = ARG_COUNT < REMOTE_REG_ARGS ? ARG_COUNT : REMOTE_REG_ARGS;
+    constexpr size_t STACK_COUNT = ARG_COUNT - REG_COUNT;
+    static_assert(STACK_COUNT <= REMOTE_MAX_STACK_ARGS, "too many arguments for a remote call");
+
+    uintptr_t ret;
+    if (regs.compat) {
+        ret = remote_call(pid, regs, func_addr, return_addr, {to_remote_word(args)...});
+    } else {
+        // One extra slot keeps the array non-empty when there are no stack arguments.
+        long stack[STACK_COUNT + 1] = {};
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            (place_remote_arg<REG_COUNT, I>(regs, stack, to_remote_word(args)), ...);
+        }(std::index_sequence_for<Args...>{});
+        ret = remote_call_prepared(pid, regs, func_addr, return_addr, stack, STACK_COUNT);
+    }
+
+    if constexpr (std::is_void_v<Ret>) {
+        (void) ret;
+    } else if constexpr (std::is_pointer_v<Ret>) {
+        return reinterpret_cast<Ret>(ret);
+    } else if constexpr (std::is_signed_v<Ret>) {
+        // A compat tracee returns 32-bit values; keep its negative results negative.
+        return regs.compat ? static_cast<Ret>(static_cast<int32_t>(ret)) : static_cast<Ret>(ret);
+    } else {
+        return static_cast<Ret>(ret);
+    }
+}
+
+/**
+ * @brief A scratch region mapped in the tracee to hold injection data.
+ *
+ * The region is obtained with a single remote `mmap()` call. Strings and argument blocks are
+ * then staged locally with `Stage()`, which returns their final remote address right away, and
+ * copied to the tracee in one bulk `process_vm_writev()` by `Flush()`. This keeps the tracee's
+ * live stack untouched and gives every injection the same, deterministic data layout.
+ */
+class RemoteArena {
+public:
+    static constexpr size_t DEFAULT_SIZE = 16 * 1024;
+
+    /// Maps the region by remotely calling `mmap_addr` (the tracee's `mmap`).
+    bool Map(int pid, RemoteRegs &regs, uintptr_t mmap_addr, uintptr_t return_addr,
+             size_t size = DEFAULT_SIZE);
+
+    /// Reserves and fills `len` bytes; returns their remote address, or 0 if the arena is full.
+    uintptr_t Stage(const void *data, size_t len, size_t align = sizeof(uintptr_t));
+
+    /// Stages a NUL-terminated copy of `str`.
+    uintptr_t StageString(std::string_view str);
+
+    /// Writes everything staged since the previous flush to the tracee.
+    bool Flush();
+
+    /// Releases the region by remotely calling `munmap_addr` (the tracee's `munmap`).
+    void Unmap(RemoteRegs &regs, uintptr_t munmap_addr, uintptr_t return_addr);
+
+    uintptr_t base() const { return base_; }
+
+private:
+    int pid_ = -1;
+    uintptr_t base_ = 0;
+    std::vector<uint8_t> local_;
+    size_t used_ = 0;
+    size_t flushed_ = 0;
+};
 
 int fork_dont_care();
 
-void wait_for_trace(int pid, int *status, int flags);
+bool tracee_skip_syscall(int pid);
+
+bool wait_for_trace(int pid, int *status, int flags);
 
 std::string parse_status(int status);
 
 #define WPTEVENT(x) (x >> 16)
 
+// A ptrace-stop caused by a seccomp filter returning SECCOMP_RET_TRACE.
+inline bool is_seccomp_stop(int status) {
+    return status >> 8 == (SIGTRAP | (PTRACE_EVENT_SECCOMP << 8));
+}
+
 #define CASE_CONST_RETURN(x)                                                                       \
     case x:                                                                                        \
         return #x;
@@ -113,5 +330,4 @@ inline const char *sigabbrev_np(int sig) {
     return "(unknown)";
 }
 
-std::string get_program(int pid);
 void *find_module_return_addr(const std::vector<MapInfo> &info, std::string_view suffix);
@@ -1,20 +1,47 @@
 #include "zygote_abi.hpp"
 
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <charconv>
 #include <csignal>
+#include <cstdlib>
+#include <ctime>
 
 #include "logging.hpp"
 #include "monitor.hpp"
 #include "utils.hpp"
 
+#if defined(__LP64__)
+static constexpr char TRACER_PATH[] = "./bin/zygisk-ptrace64";
+#else
+static constexpr char TRACER_PATH[] = "./bin/zygisk-ptrace32";
+#endif
+
 ZygoteAbiManager::ZygoteAbiManager(AppMonitor& monitor, bool is_64bit)
     : abi_name_(is_64bit ? "64" : "32"),
       program_path_(is_64bit ? "/system/bin/app_process64" : "/system/bin/app_process32"),
-      tracer_path_(is_64bit ? "./bin/zygisk-ptrace64" : "./bin/zygisk-ptrace32"),
+      governor_(abi_name_),
+      daemon_path_(is_64bit ? "./bin/zygiskd64" : "./bin/zygiskd32"),
+      tracer_path_(TRACER_PATH),
       monitor_(monitor) {}
 
+void ZygoteAbiManager::refresh_program_identity() {
+    struct stat st;
+    if (stat(program_path_.c_str(), &st) == -1) {
+        program_dev_ = 0;
+        program_ino_ = 0;
+        return;
+    }
+    if (st.st_dev != program_dev_ || st.st_ino != program_ino_) {
+        LOGV("%s is [%lu:%lu]", program_path_.c_str(), static_cast<unsigned long>(st.st_dev),
+             static_cast<unsigned long>(st.st_ino));
+    }
+    program_dev_ = st.st_dev;
+    program_ino_ = st.st_ino;
+}
+
 const Status& ZygoteAbiManager::get_status() const { return status_; }
 
 void ZygoteAbiManager::notify_injected() { status_.zygote_injected = true; }
@@ -26,45 +53,130 @@ void ZygoteAbiManager::set_daemon_crashed(std::string_view error) {
     status_.daemon_error_info = error;
 }
 
-bool ZygoteAbiManager::is_in_crash_loop() {
+void ZygoteAbiManager::set_injection_timeline(std::string_view timeline) {
+    status_.injection_count++;
+    status_.injection_timeline = timeline;
+}
+
+static time_t monotonic_seconds() {
     struct timespec now{};
     clock_gettime(CLOCK_MONOTONIC, &now);
-    if (now.tv_sec - counter.last_start_time.tv_sec < ZygoteAbiManager::CRASH_LOOP_WINDOW_SECONDS) {
-        counter.count++;
-    } else {
-        counter.count = 1;
+    return now.tv_sec;
+}
+
+static long monotonic_ms() {
+    struct timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+
+void ZygoteAbiManager::set_daemon_ready() {
+    status_.daemon_ready_ms = monotonic_ms() - daemon_spawned_ms_;
+    LOGI("daemon%s ready after %ldms", abi_name_, status_.daemon_ready_ms);
+}
+
+void ZygoteAbiManager::set_daemon_stats(std::string_view stats) {
+    status_.daemon_stats = stats;
+    // The number of loaded modules bounds the crash governor's bisection.
+    constexpr std::string_view prefix = "modules=";
+    if (!stats.starts_with(prefix)) return;
+    auto count = stats.substr(prefix.size());
+    int modules;
+    auto [end, ec] = std::from_chars(count.data(), count.data() + count.size(), modules);
+    if (ec != std::errc() || modules < 0) {
+        LOGW("ZygoteAbiManager: bad module count from daemon%s", abi_name_);
+        return;
     }
-    counter.last_start_time = now;
-    return counter.count >= ZygoteAbiManager::CRASH_LOOP_RETRY_COUNT;
+    governor_.SetModuleCount(modules);
 }
 
-bool ZygoteAbiManager::ensure_daemon_created() {
-    status_.zygote_injected = false;
-    if (status_.daemon_pid == -1) {
-        auto pid = fork();
-        if (pid < 0) {
-            PLOGE("create daemon (abi=%s)", abi_name_);
-            return false;
-        }
-        if (pid == 0) {
-            std::string daemon_name = "./bin/zygiskd";
-            daemon_name += abi_name_;
-            execl(daemon_name.c_str(), daemon_name.c_str(), nullptr);
-            PLOGE("exec daemon %s", daemon_name.c_str());
-            exit(1);
+void ZygoteAbiManager::reset_crash_governor() { governor_.Reset(); }
+
+void ZygoteAbiManager::on_governor_timer() { governor_.OnTimer(monotonic_seconds()); }
+
+time_t ZygoteAbiManager::governor_deadline() const { return governor_.NextDeadline(); }
+
+std::string ZygoteAbiManager::governor_status() const {
+    return governor_.Describe(monotonic_seconds());
+}
+
+void ZygoteAbiManager::write_stats(std::string& out) const {
+    auto put = [&](std::string_view key, std::string_view value) {
+        out += "zygote";
+        out += abi_name_;
+        out += ".";
+        out += key;
+        out += "=";
+        out += value;
+        out += "\n";
+    };
+    put("supported", status_.supported ? "1" : "0");
+    if (!status_.supported) return;
+    put("injected", status_.zygote_injected ? "1" : "0");
+    put("injection_count", std::to_string(status_.injection_count));
+    put("injection_timeline", status_.injection_timeline);
+    put("daemon_running", status_.daemon_running ? "1" : "0");
+    put("daemon_pid", std::to_string(status_.daemon_pid));
+    put("daemon_ready_ms", std::to_string(status_.daemon_ready_ms));
+    governor_.WriteStats(monotonic_seconds(), put);
+    // The daemon's own counters are already `key=value` lines.
+    size_t start = 0;
+    std::string_view stats = status_.daemon_stats;
+    while (start < stats.size()) {
+        size_t end = stats.find('\n', start);
+        if (end == std::string_view::npos) end = stats.size();
+        auto line = stats.substr(start, end - start);
+        if (auto eq = line.find('='); eq != std::string_view::npos) {
+            put(std::string("daemon.").append(line.substr(0, eq)), line.substr(eq + 1));
         }
-        status_.supported = true;
-        status_.daemon_pid = pid;
-        status_.daemon_running = true;
+        start = end + 1;
+    }
+}
+
+/**
+ * @brief Spawns the daemon as soon as the monitor starts.
+ *
+ * The daemon then loads its modules while the system is still booting towards zygote, instead of
+ * after zygote started and waits for it. It reports `DAEMON_READY` once it listens.
+ */
+void ZygoteAbiManager::start_daemon() {
+    if (status_.daemon_pid != -1 || access(daemon_path_.c_str(), X_OK) != 0) return;
+    auto pid = fork();
+    if (pid < 0) {
+        PLOGE("create daemon (abi=%s)", abi_name_);
+        return;
+    }
+    if (pid == 0) {
+        execl(daemon_path_.c_str(), daemon_path_.c_str(), nullptr);
+        PLOGE("exec daemon %s", daemon_path_.c_str());
+        exit(1);
     }
+    daemon_spawned_ms_ = monotonic_ms();
+    status_.supported = true;
+    status_.daemon_pid = pid;
+    status_.daemon_running = true;
+}
+
+bool ZygoteAbiManager::ensure_daemon_created() {
+    status_.zygote_injected = false;
+    // Normally started along with the monitor; this only covers a failed early start.
+    start_daemon();
     return status_.daemon_running;
 }
 
-const char* ZygoteAbiManager::check_and_prepare_injection() {
-    if (is_in_crash_loop()) {
-        monitor_.request_stop("zygote crashed");
+const char* ZygoteAbiManager::check_and_prepare_injection(uint32_t& disabled_modules) {
+    // The module only ships the daemon of a secondary ABI if the device can run it. Without it,
+    // this zygote is left alone instead of stopping the monitor for every ABI.
+    if (access(daemon_path_.c_str(), X_OK) != 0) {
+        LOGW("ZygoteAbiManager: no daemon for zygote%s, not injecting", abi_name_);
+        return nullptr;
+    }
+    auto decision = governor_.OnZygoteStart(monotonic_seconds());
+    if (!decision.inject) {
+        LOGW("ZygoteAbiManager: not injecting zygote%s while backing off", abi_name_);
         return nullptr;
     }
+    disabled_modules = decision.disabled_modules;
     if (!ensure_daemon_created()) {
         monitor_.request_stop("daemon not running");
         return nullptr;
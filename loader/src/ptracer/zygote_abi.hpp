@@ -5,6 +5,7 @@
 #include <string>
 #include <string_view>
 
+#include "crash_governor.hpp"
 #include "types.hpp"
 
 // Forward declaration to break circular dependency
@@ -14,36 +15,63 @@ class AppMonitor;
  * @brief Manages all state and logic for a single target architecture (ABI).
  *
  * This class is responsible for tracking the status of Zygote and the helper
- * daemon for a specific ABI (e.g., 64-bit). It handles crash-loop detection,
- * daemon creation, and pre-injection safety checks.
+ * daemon for a specific ABI (e.g., 64-bit). It handles daemon creation and
+ * pre-injection safety checks, and asks its CrashGovernor how to treat every
+ * zygote start.
+ *
+ * Every ABI is injected by the monitor's own tracer binary; a 64-bit tracer
+ * handles the 32-bit zygote in compat mode.
  */
 class ZygoteAbiManager {
 public:
-    static constexpr int CRASH_LOOP_RETRY_COUNT = 5;
-    static constexpr int CRASH_LOOP_WINDOW_SECONDS = 30;
-
     ZygoteAbiManager(AppMonitor& monitor, bool is_64bit);
 
     // Public Interface for event handling
     bool handle_daemon_exit_if_match(int pid, int process_status);
-    const char* check_and_prepare_injection();
+    /// Spawns the daemon ahead of zygote, if this ABI has one; see `ensure_daemon_created()`.
+    void start_daemon();
+    /// Returns the tracer to run, or nullptr if this zygote start is not injected.
+    const char* check_and_prepare_injection(uint32_t& disabled_modules);
+    void reset_crash_governor();
+    /// Lets the crash governor act on a deadline; see `CrashGovernor::OnTimer()`.
+    void on_governor_timer();
+    /// CLOCK_MONOTONIC second of the governor's next deadline, or 0 if none.
+    time_t governor_deadline() const;
+    /// Re-reads the (device, inode) of `program_path_`, e.g. after the mount table changed.
+    void refresh_program_identity();
+    /// True if an executable with this identity is this ABI's zygote.
+    bool is_program(dev_t dev, ino_t ino) const {
+        return program_ino_ != 0 && ino == program_ino_ && dev == program_dev_;
+    }
+    /// What the crash governor currently holds back; empty if nothing.
+    std::string governor_status() const;
 
     // Public methods for state modification
     const Status& get_status() const;
     void notify_injected();
     void set_daemon_info(std::string_view info);
     void set_daemon_crashed(std::string_view error);
+    void set_injection_timeline(std::string_view timeline);
+    void set_daemon_stats(std::string_view stats);
+    void set_daemon_ready();
+
+    /// Appends the `key=value` statistics of this ABI, prefixed with `zygote<abi>.`.
+    void write_stats(std::string& out) const;
 
     const char* const abi_name_;
     const std::string program_path_;
 
 private:
-    bool is_in_crash_loop();
     bool ensure_daemon_created();
 
     Status status_;
-    StartCounter counter;
+    CrashGovernor governor_;
+    long daemon_spawned_ms_ = 0;
+    // Identity of `program_path_`; zero if it does not exist, e.g. on 64-bit only devices.
+    dev_t program_dev_ = 0;
+    ino_t program_ino_ = 0;
 
+    const std::string daemon_path_;
     const char* const tracer_path_;
     AppMonitor& monitor_;
 };
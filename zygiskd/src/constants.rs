@@ -36,6 +36,10 @@ pub const PATH_MODULES_DIR: &str = "..";
 // --- IPC Constants ---
 // These are magic numbers used in communication with the controller.
 
+/// Starts every datagram sent to the controller (format version 1); see `utils::MonitorMessage`.
+pub const MONITOR_MSG_MAGIC: u32 = 0x315a4b4d;
+/// The largest datagram the controller accepts.
+pub const MONITOR_MSG_MAX: usize = 16 * 1024;
 /// IPC code indicating that Zygote has been successfully injected.
 pub const ZYGOTE_INJECTED: i32 = 4;
 /// IPC code for sending daemon status information.
@@ -44,6 +48,10 @@ pub const DAEMON_SET_INFO: i32 = 5;
 pub const DAEMON_SET_ERROR_INFO: i32 = 6;
 /// IPC code indicating that the Android system server has started.
 pub const SYSTEM_SERVER_STARTED: i32 = 7;
+/// IPC code for pushing the daemon's request counters.
+pub const DAEMON_STATS: i32 = 9;
+/// IPC code announcing that the daemon listens on its socket.
+pub const DAEMON_READY: i32 = 11;
 
 /// Defines the set of actions that can be requested from the daemon over its main Unix socket.
 #[derive(Debug, Eq, PartialEq, TryFromPrimitive, Copy, Clone)]
@@ -75,6 +75,7 @@ mod constants;
 mod dl;
 mod mount;
 mod root_impl;
+mod stats;
 mod utils;
 mod zygiskd;
 
@@ -66,6 +66,21 @@ pub fn detect_version() -> Option<Version> {
     }
 }
 
+/// Returns the package name of the detected Magisk variant, if Magisk was detected.
+pub fn variant_pkg() -> Option<&'static str> {
+    MAGISK_VARIANT_PKG.get().copied()
+}
+
+/// Restores the variant package name from an earlier detection without running `magisk -v`.
+pub fn restore_variant(pkg_name: &str) {
+    let pkg = MAGISK_THIRD_PARTIES
+        .iter()
+        .map(|(_, pkg)| *pkg)
+        .find(|pkg| *pkg == pkg_name)
+        .unwrap_or(MAGISK_OFFICIAL_PKG);
+    MAGISK_VARIANT_PKG.get_or_init(|| pkg);
+}
+
 /// Checks if a UID has been granted root by querying the Magisk database.
 pub fn uid_granted_root(uid: i32) -> bool {
     let query = format!("SELECT 1 FROM policies WHERE uid={uid} AND policy=2 LIMIT 1");
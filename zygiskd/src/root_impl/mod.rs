@@ -3,13 +3,21 @@
 //! A module for detecting and interfacing with the underlying root solution.
 //!
 //! It supports APatch, KernelSU, and Magisk. The active root solution is detected
-//! once at startup and cached for all subsequent calls.
+//! once at startup and cached for all subsequent calls. Since detection spawns several
+//! subprocesses, its result is also persisted under `TMP_PATH`, keyed by the boot id, so that
+//! a daemon restarted within the same boot skips it.
 
 mod apatch;
 mod kernelsu;
 mod magisk;
 
+use log::{debug, warn};
+use std::fs;
 use std::sync::OnceLock;
+use std::thread;
+
+const BOOT_ID_PATH: &str = "/proc/sys/kernel/random/boot_id";
+const CACHE_FILE: &str = "root_impl";
 
 /// Represents the detected root solution on the system.
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
@@ -35,9 +43,17 @@ static ROOT_IMPL: OnceLock<RootImpl> = OnceLock::new();
 ///
 /// This function should only be called once. `get()` handles this logic automatically.
 fn detect_root() -> RootImpl {
-    let apatch_version = apatch::detect_version();
-    let ksu_version = kernelsu::detect_version();
-    let magisk_version = magisk::detect_version();
+    // Each probe waits on its own subprocess or syscall, so they run concurrently.
+    let (apatch_version, ksu_version, magisk_version) = thread::scope(|s| {
+        let apatch = s.spawn(apatch::detect_version);
+        let magisk = s.spawn(magisk::detect_version);
+        let ksu = kernelsu::detect_version();
+        (
+            apatch.join().ok().flatten(),
+            ksu,
+            magisk.join().ok().flatten(),
+        )
+    });
 
     let detections = [
         apatch_version.is_some(),
@@ -72,11 +88,116 @@ fn detect_root() -> RootImpl {
     RootImpl::None
 }
 
+impl RootImpl {
+    fn from_name(name: &str) -> Option<Self> {
+        Some(match name {
+            "None" => RootImpl::None,
+            "TooOld" => RootImpl::TooOld,
+            "Multiple" => RootImpl::Multiple,
+            "APatch" => RootImpl::APatch,
+            "KernelSU" => RootImpl::KernelSU,
+            "Magisk" => RootImpl::Magisk,
+            _ => return None,
+        })
+    }
+}
+
+/// Returns the path of the detection cache, or `None` outside of the daemon's environment.
+fn cache_path() -> Option<String> {
+    let tmp_path = std::env::var("TMP_PATH").ok()?;
+    Some(format!("{}/{}", tmp_path, CACHE_FILE))
+}
+
+/// Loads a detection result persisted earlier in the current boot.
+///
+/// The cache holds `key=value` lines: the boot id it was written in, the detected backend and,
+/// for Magisk, the package of the installed variant, which is also its manager app.
+fn load_cached(path: &str, boot_id: &str) -> Option<RootImpl> {
+    let content = fs::read_to_string(path).ok()?;
+    let mut cached_boot_id = None;
+    let mut backend = None;
+    let mut variant = None;
+    for line in content.lines() {
+        match line.split_once('=') {
+            Some(("boot_id", value)) => cached_boot_id = Some(value),
+            Some(("backend", value)) => backend = RootImpl::from_name(value),
+            Some(("variant", value)) => variant = Some(value),
+            _ => {}
+        }
+    }
+    if cached_boot_id != Some(boot_id) {
+        return None;
+    }
+
+    let root_impl = backend?;
+    match root_impl {
+        // Only detected backends are stored; anything else is probed again.
+        RootImpl::None | RootImpl::TooOld | RootImpl::Multiple => return None,
+        // The ioctl fd KernelSU is driven through cannot be cached; reacquiring it only costs a
+        // few syscalls.
+        RootImpl::KernelSU => {
+            if !matches!(
+                kernelsu::detect_version(),
+                Some(kernelsu::Version::Supported)
+            ) {
+                return None;
+            }
+        }
+        RootImpl::Magisk => magisk::restore_variant(variant?),
+        _ => {}
+    }
+    Some(root_impl)
+}
+
+/// Persists a detection result for daemon restarts within the same boot.
+fn store_cached(path: &str, boot_id: &str, root_impl: RootImpl) {
+    let mut content = format!("boot_id={}\nbackend={:?}\n", boot_id, root_impl);
+    if root_impl == RootImpl::Magisk {
+        if let Some(pkg) = magisk::variant_pkg() {
+            content += &format!("variant={}\n", pkg);
+        }
+    }
+    // Write to a temporary file and rename it, so a concurrent reader never sees a partial cache.
+    // The daemons of both ABIs start together, so each writes its own temporary file.
+    let tmp = format!("{}.{}.tmp", path, std::process::id());
+    if let Err(e) = fs::write(&tmp, content).and_then(|_| fs::rename(&tmp, path)) {
+        warn!("Failed to store root implementation cache: {}", e);
+    }
+}
+
 /// Performs the root detection and caches the result.
 /// This must be called once near startup before any other functions in this module are used.
 pub fn setup() {
+    let boot_id = fs::read_to_string(BOOT_ID_PATH)
+        .map(|id| id.trim().to_string())
+        .ok();
+    let cache = cache_path().zip(boot_id);
+
+    let cached = cache
+        .as_ref()
+        .and_then(|(path, boot_id)| load_cached(path, boot_id));
+    let root_impl = match cached {
+        Some(root_impl) => {
+            debug!("Reusing root implementation detected earlier in this boot");
+            root_impl
+        }
+        None => {
+            let root_impl = detect_root();
+            // A failed probe, e.g. early in boot or while the root app is being updated, must not
+            // outlive the daemon; only a detected backend is worth reusing.
+            let detected = matches!(
+                root_impl,
+                RootImpl::APatch | RootImpl::KernelSU | RootImpl::Magisk
+            );
+            if let Some((path, boot_id)) = cache.as_ref().filter(|_| detected) {
+                store_cached(path, boot_id, root_impl);
+            }
+            root_impl
+        }
+    };
+
     ROOT_IMPL
-        .set(detect_root())
+        .set(root_impl)
         .expect("setup() should only be called once");
 }
 
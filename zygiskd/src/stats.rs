@@ -0,0 +1,116 @@
+// src/stats.rs
+
+//! Request counters that the daemon reports to the monitor.
+//!
+//! Every action served on the daemon socket is counted together with the time spent handling
+//! it, and every companion spawn is timed per module. A background thread periodically pushes a
+//! snapshot to the monitor as a `DAEMON_STATS` message, one `key=value` pair per line, which the
+//! monitor serves to `zygisk-ctl stats`.
+
+use crate::constants::{self, DaemonSocketAction};
+use crate::utils;
+use log::warn;
+use std::collections::BTreeMap;
+use std::fmt::Write;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Mutex, OnceLock};
+use std::thread;
+use std::time::{Duration, Instant};
+
+/// How often a snapshot is pushed to the monitor.
+const PUSH_INTERVAL: Duration = Duration::from_secs(30);
+const ACTION_COUNT: usize = DaemonSocketAction::SystemServerStarted as usize + 1;
+
+struct Counter {
+    count: AtomicU64,
+    total_us: AtomicU64,
+    max_us: AtomicU64,
+}
+
+impl Counter {
+    const fn new() -> Self {
+        Self {
+            count: AtomicU64::new(0),
+            total_us: AtomicU64::new(0),
+            max_us: AtomicU64::new(0),
+        }
+    }
+
+    fn add(&self, elapsed: Duration) {
+        let us = elapsed.as_micros() as u64;
+        self.count.fetch_add(1, Ordering::Relaxed);
+        self.total_us.fetch_add(us, Ordering::Relaxed);
+        self.max_us.fetch_max(us, Ordering::Relaxed);
+    }
+
+    fn write(&self, out: &mut String, prefix: &str) {
+        let count = self.count.load(Ordering::Relaxed);
+        let total = self.total_us.load(Ordering::Relaxed);
+        let _ = writeln!(out, "{prefix}.count={count}");
+        let _ = writeln!(out, "{prefix}.total_us={total}");
+        let _ = writeln!(out, "{prefix}.max_us={}", self.max_us.load(Ordering::Relaxed));
+    }
+}
+
+static ACTIONS: [Counter; ACTION_COUNT] = [const { Counter::new() }; ACTION_COUNT];
+static COMPANIONS: Mutex<BTreeMap<String, (u64, u64)>> = Mutex::new(BTreeMap::new());
+static STARTED: OnceLock<Instant> = OnceLock::new();
+static MODULE_COUNT: OnceLock<usize> = OnceLock::new();
+
+/// Records one served request.
+pub fn record_action(action: DaemonSocketAction, elapsed: Duration) {
+    ACTIONS[action as usize].add(elapsed);
+}
+
+/// Records the time spent spawning the companion of a module.
+pub fn record_companion_spawn(module: &str, elapsed: Duration) {
+    let mut companions = COMPANIONS.lock().unwrap();
+    let entry = companions.entry(module.to_string()).or_default();
+    entry.0 += 1;
+    entry.1 += elapsed.as_micros() as u64;
+}
+
+/// Formats the counters, one `key=value` pair per line.
+pub fn snapshot() -> String {
+    let mut out = String::new();
+    // Must stay the first line: the monitor's crash governor reads it.
+    let _ = writeln!(out, "modules={}", MODULE_COUNT.get().copied().unwrap_or(0));
+    let uptime = STARTED.get().map_or(0, |started| started.elapsed().as_secs());
+    let _ = writeln!(out, "uptime_s={uptime}");
+    for (index, counter) in ACTIONS.iter().enumerate() {
+        if counter.count.load(Ordering::Relaxed) == 0 {
+            continue;
+        }
+        if let Ok(action) = DaemonSocketAction::try_from(index as u8) {
+            counter.write(&mut out, &format!("rpc.{action:?}"));
+        }
+    }
+    for (module, (spawns, total_us)) in COMPANIONS.lock().unwrap().iter() {
+        let _ = writeln!(out, "module.{module}.companion_spawns={spawns}");
+        let _ = writeln!(out, "module.{module}.companion_spawn_us={total_us}");
+    }
+    out
+}
+
+/// Starts counting for a daemon that loaded `module_count` modules.
+pub fn init(module_count: usize) {
+    STARTED.get_or_init(Instant::now);
+    MODULE_COUNT.get_or_init(|| module_count);
+}
+
+/// Starts the thread that pushes snapshots to the monitor listening on `controller_socket`.
+///
+/// The first snapshot goes out with the startup info, so this one waits a full interval.
+pub fn start_reporter(controller_socket: &'static str) {
+    thread::spawn(move || {
+        loop {
+            thread::sleep(PUSH_INTERVAL);
+            let result = utils::MonitorMessage::new()
+                .push(constants::DAEMON_STATS, snapshot().as_bytes())
+                .send_to(controller_socket);
+            if let Err(e) = result {
+                warn!("Failed to push stats to the monitor: {}", e);
+            }
+        }
+    });
+}
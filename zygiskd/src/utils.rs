@@ -7,7 +7,8 @@
 //! - Low-level Unix socket and pipe I/O.
 //! - A trait (`UnixStreamExt`) for simplified socket communication.
 
-use anyhow::Result;
+use crate::constants;
+use anyhow::{Result, bail};
 use rustix::net::{
     AddressFamily, SendFlags, SocketAddrUnix, SocketType, bind, connect, listen, sendto, socket,
 };
@@ -181,6 +182,37 @@ pub fn unix_datagram_sendto(path: &str, buf: &[u8]) -> Result<()> {
     Ok(())
 }
 
+/// A datagram for the controller: `MONITOR_MSG_MAGIC`, then one or more records, each an IPC
+/// code, the payload length as a `u32`, and the payload. Batching several records into one
+/// datagram lets the controller handle them in one wakeup.
+pub struct MonitorMessage {
+    buf: Vec<u8>,
+}
+
+impl MonitorMessage {
+    pub fn new() -> Self {
+        Self {
+            buf: constants::MONITOR_MSG_MAGIC.to_le_bytes().to_vec(),
+        }
+    }
+
+    /// Appends a record.
+    pub fn push(&mut self, code: i32, payload: &[u8]) -> &mut Self {
+        self.buf.extend_from_slice(&code.to_le_bytes());
+        self.buf.extend_from_slice(&(payload.len() as u32).to_le_bytes());
+        self.buf.extend_from_slice(payload);
+        self
+    }
+
+    /// Sends every record pushed so far as a single datagram.
+    pub fn send_to(&self, path: &str) -> Result<()> {
+        if self.buf.len() > constants::MONITOR_MSG_MAX {
+            bail!("Message of {} bytes exceeds the controller's limit", self.buf.len());
+        }
+        unix_datagram_sendto(path, &self.buf)
+    }
+}
+
 /// Checks if a Unix socket is still alive and connected using `poll`.
 pub fn is_socket_alive(stream: &UnixStream) -> bool {
     let pfd = libc::pollfd {
@@ -12,7 +12,7 @@
 use crate::constants::{DaemonSocketAction, ProcessFlags, ZKSU_VERSION};
 use crate::mount::{MountNamespace, MountNamespaceManager};
 use crate::utils::{self, UnixStreamExt};
-use crate::{constants, lp_select, root_impl};
+use crate::{constants, lp_select, root_impl, stats};
 use anyhow::{Context as AnyhowContext, Result, bail};
 use log::{debug, error, info, trace, warn};
 use passfd::FdPassingExt;
@@ -21,27 +21,45 @@ use std::fs;
 use std::io::Error;
 use std::os::fd::AsRawFd;
 use std::os::fd::{AsFd, OwnedFd, RawFd};
+use std::os::unix::fs::MetadataExt;
 use std::os::unix::process::CommandExt;
 use std::{
     os::unix::net::{UnixListener, UnixStream},
     path::Path,
     process::Command,
-    sync::{Arc, Mutex, OnceLock},
+    sync::{
+        Arc, Mutex, OnceLock,
+        atomic::{AtomicU32, Ordering},
+    },
     thread,
+    time::Instant,
 };
 
 /// Represents a loaded Zygisk module.
 struct Module {
     name: String,
     lib_fd: OwnedFd,
+    /// The module ships `zygisk/preload`, asking to be loaded into zygote itself.
+    preload: bool,
     /// A handle to the module's companion process socket, if it exists and is running.
     companion: Mutex<Option<UnixStream>>,
+    /// A sealed copy of `zygisk/config`, if the module ships one.
+    config: Mutex<Option<ConfigBlob>>,
+}
+
+/// A module's config file, read into a sealed memfd that every process maps read-only.
+struct ConfigBlob {
+    /// Identifies the version of the file the blob was read from.
+    stamp: (u64, i64, i64, u64),
+    fd: OwnedFd,
 }
 
 /// The shared context for the daemon, containing all loaded modules and a mount namespace manager
 struct AppContext {
     modules: Vec<Module>,
     mount_manager: Arc<MountNamespaceManager>,
+    /// Bit `i` set: module `i` is held back by the monitor's crash governor.
+    disabled_modules: AtomicU32,
 }
 
 // Global paths, initialized once at startup.
@@ -55,14 +73,18 @@ pub fn main() -> Result<()> {
 
     initialize_globals()?;
     let modules = load_modules()?;
+    stats::init(modules.len());
+    // Listen before announcing anything, so that the controller only hears of a ready daemon.
+    let listener = create_daemon_socket()?;
     send_startup_info(&modules)?;
+    stats::start_reporter(CONTROLLER_SOCKET.get().unwrap());
 
     let mount_manager = Arc::new(MountNamespaceManager::new());
     let context = Arc::new(AppContext {
         modules,
         mount_manager,
+        disabled_modules: AtomicU32::new(0),
     });
-    let listener = create_daemon_socket()?;
 
     info!("Daemon listening on {}", DAEMON_SOCKET_PATH.get().unwrap());
 
@@ -84,6 +106,7 @@ fn handle_connection(mut stream: UnixStream, context: Arc<AppContext>) -> Result
     let action = DaemonSocketAction::try_from(action)
         .with_context(|| format!("Invalid daemon action code: {}", action))?;
     trace!("New daemon action: {:?}", action);
+    let started = Instant::now();
 
     match action {
         // These actions are lightweight and handled synchronously.
@@ -97,18 +120,35 @@ fn handle_connection(mut stream: UnixStream, context: Arc<AppContext>) -> Result
                 .save_mount_namespace(pid, MountNamespace::Root)?;
         }
         DaemonSocketAction::PingHeartbeat => {
-            let value = constants::ZYGOTE_INJECTED;
-            utils::unix_datagram_sendto(CONTROLLER_SOCKET.get().unwrap(), &value.to_le_bytes())?;
+            utils::MonitorMessage::new()
+                .push(constants::ZYGOTE_INJECTED, &[])
+                .send_to(CONTROLLER_SOCKET.get().unwrap())?;
         }
         DaemonSocketAction::ZygoteRestart => {
             info!("Zygote restarted, cleaning up companion sockets.");
+            let mut disabled = stream.read_u32()?;
+            // The mask indexes this daemon's modules; bits past them mean it was meant for the
+            // daemon of another ABI.
+            let module_count = context.modules.len();
+            if module_count < 32 && disabled >> module_count != 0 {
+                warn!(
+                    "Disabled modules {:#x} exceed the {} modules of this daemon, ignoring them.",
+                    disabled, module_count
+                );
+                disabled &= (1u32 << module_count) - 1;
+            }
+            if disabled != 0 {
+                warn!("Crash governor disabled modules {:#x} for this zygote.", disabled);
+            }
+            context.disabled_modules.store(disabled, Ordering::Relaxed);
             for module in &context.modules {
                 module.companion.lock().unwrap().take();
             }
         }
         DaemonSocketAction::SystemServerStarted => {
-            let value = constants::SYSTEM_SERVER_STARTED;
-            utils::unix_datagram_sendto(CONTROLLER_SOCKET.get().unwrap(), &value.to_le_bytes())?;
+            utils::MonitorMessage::new()
+                .push(constants::SYSTEM_SERVER_STARTED, &[])
+                .send_to(CONTROLLER_SOCKET.get().unwrap())?;
         }
         // Heavier actions are spawned into a separate thread.
         _ => {
@@ -121,9 +161,12 @@ fn handle_connection(mut stream: UnixStream, context: Arc<AppContext>) -> Result
                         e.backtrace()
                     );
                 }
+                stats::record_action(action, started.elapsed());
             });
+            return Ok(());
         }
     }
+    stats::record_action(action, started.elapsed());
     Ok(())
 }
 
@@ -166,16 +209,16 @@ fn initialize_globals() -> Result<()> {
     Ok(())
 }
 
-/// Sends initial status information to the controller.
+/// Sends initial status information to the controller, batched with the first stats snapshot so
+/// that the controller learns the module count in the same wakeup, and with the readiness
+/// notice, since the daemon socket is listening by now.
 fn send_startup_info(modules: &[Module]) -> Result<()> {
-    let mut msg = Vec::<u8>::new();
-    let info = match root_impl::get() {
+    let (code, info) = match root_impl::get() {
         root_impl::RootImpl::APatch
         | root_impl::RootImpl::KernelSU
         | root_impl::RootImpl::Magisk => {
-            msg.extend_from_slice(&constants::DAEMON_SET_INFO.to_le_bytes());
             let module_names: Vec<_> = modules.iter().map(|m| m.name.as_str()).collect();
-            if !module_names.is_empty() {
+            let info = if !module_names.is_empty() {
                 format!(
                     "\t\tRoot: {:?}\n\t\tModules ({}):\n\t\t\t{}",
                     root_impl::get(),
@@ -184,17 +227,21 @@ fn send_startup_info(modules: &[Module]) -> Result<()> {
                 )
             } else {
                 format!("\t\tRoot: {:?}", root_impl::get())
-            }
-        }
-        _ => {
-            msg.extend_from_slice(&constants::DAEMON_SET_ERROR_INFO.to_le_bytes());
-            format!("\t\tInvalid root implementation: {:?}", root_impl::get())
+            };
+            (constants::DAEMON_SET_INFO, info)
         }
+        _ => (
+            constants::DAEMON_SET_ERROR_INFO,
+            format!("\t\tInvalid root implementation: {:?}", root_impl::get()),
+        ),
     };
-    msg.extend_from_slice(&(info.len() as u32 + 1).to_le_bytes());
-    msg.extend_from_slice(info.as_bytes());
-    msg.push(0); // Null terminator
-    utils::unix_datagram_sendto(CONTROLLER_SOCKET.get().unwrap(), &msg)
+    let mut payload = info.into_bytes();
+    payload.push(0); // Null terminator
+    utils::MonitorMessage::new()
+        .push(code, &payload)
+        .push(constants::DAEMON_STATS, stats::snapshot().as_bytes())
+        .push(constants::DAEMON_READY, &[])
+        .send_to(CONTROLLER_SOCKET.get().unwrap())
         .context("Failed to send startup info to controller")
 }
 
@@ -233,14 +280,23 @@ fn load_modules() -> Result<Vec<Module>> {
             continue;
         }
 
-        info!("Loading module `{}`...", name);
-        match create_library_fd(&so_path) {
+        let preload = entry.path().join("zygisk/preload").exists();
+        info!(
+            "Loading module `{}`{}...",
+            name,
+            if preload { " (preloaded in zygote)" } else { "" }
+        );
+        match create_sealed_fd("zygisk-module", &so_path) {
             Ok(lib_fd) => {
-                modules.push(Module {
+                let module = Module {
                     name,
                     lib_fd,
+                    preload,
                     companion: Mutex::new(None),
-                });
+                    config: Mutex::new(None),
+                };
+                refresh_config(&module);
+                modules.push(module);
             }
             Err(e) => {
                 warn!("Failed to create memfd for `{}`: {}", name, e);
@@ -251,14 +307,15 @@ fn load_modules() -> Result<Vec<Module>> {
     Ok(modules)
 }
 
-/// Creates a sealed, read-only memfd containing the module's shared library.
-/// This is a security measure to prevent the library from being tampered with after loading.
-fn create_library_fd(so_path: &Path) -> Result<OwnedFd> {
+/// Creates a sealed, read-only memfd containing a copy of the file at `path`, e.g. a module's
+/// shared library. This is a security measure to prevent the content from being tampered with
+/// after loading.
+fn create_sealed_fd(name: &str, path: &Path) -> Result<OwnedFd> {
     let opts = memfd::MemfdOptions::default().allow_sealing(true);
-    let memfd = opts.create("zygisk-module")?;
+    let memfd = opts.create(name)?;
 
-    // Copy the library content into the memfd.
-    let file = fs::File::open(so_path)?;
+    // Copy the file content into the memfd.
+    let file = fs::File::open(path)?;
     let mut reader = std::io::BufReader::new(file);
     let mut writer = memfd.as_file();
     std::io::copy(&mut reader, &mut writer)?;
@@ -278,6 +335,28 @@ fn create_library_fd(so_path: &Path) -> Result<OwnedFd> {
     Ok(OwnedFd::from(memfd.into_file()))
 }
 
+/// Re-reads the module's `zygisk/config` into a new blob if the file changed since it was last
+/// read, and drops the blob if the file is gone.
+fn refresh_config(module: &Module) {
+    let path = format!("{}/{}/zygisk/config", constants::PATH_MODULES_DIR, module.name);
+    let mut config = module.config.lock().unwrap();
+    let Ok(meta) = fs::metadata(&path) else {
+        *config = None;
+        return;
+    };
+    let stamp = (meta.ino(), meta.mtime(), meta.mtime_nsec(), meta.len());
+    if config.as_ref().is_some_and(|blob| blob.stamp == stamp) {
+        return;
+    }
+    match create_sealed_fd("zygisk-config", Path::new(&path)) {
+        Ok(fd) => {
+            debug!("Read config of module `{}` ({} bytes)", module.name, meta.len());
+            *config = Some(ConfigBlob { stamp, fd });
+        }
+        Err(e) => warn!("Failed to read config of module `{}`: {}", module.name, e),
+    }
+}
+
 /// Creates and binds the main daemon Unix socket.
 fn create_daemon_socket() -> Result<UnixListener> {
     utils::set_socket_create_context("u:r:zygote:s0")?;
@@ -393,10 +472,26 @@ fn handle_update_mount_namespace(stream: &mut UnixStream, context: &AppContext)
 }
 
 fn handle_read_modules(stream: &mut UnixStream, context: &AppContext) -> Result<()> {
-    stream.write_usize(context.modules.len())?;
-    for module in &context.modules {
+    let disabled = context.disabled_modules.load(Ordering::Relaxed);
+    let enabled: Vec<_> = context
+        .modules
+        .iter()
+        .enumerate()
+        .filter(|(index, _)| *index >= 32 || disabled & (1 << *index) == 0)
+        .collect();
+    stream.write_usize(enabled.len())?;
+    for (index, module) in enabled {
+        // Indexes keep addressing the module in companion and module dir requests.
+        stream.write_usize(index)?;
         stream.write_string(&module.name)?;
+        stream.write_u8(module.preload as u8)?;
+        refresh_config(module);
+        let config = module.config.lock().unwrap();
+        stream.write_u8(config.is_some() as u8)?;
         stream.send_fd(module.lib_fd.as_raw_fd())?;
+        if let Some(blob) = config.as_ref() {
+            stream.send_fd(blob.fd.as_raw_fd())?;
+        }
     }
     Ok(())
 }
@@ -419,7 +514,10 @@ fn handle_request_companion_socket(stream: &mut UnixStream, context: &AppContext
 
     // If no companion exists, try to spawn one.
     if companion.is_none() {
-        match spawn_companion(&module.name, module.lib_fd.as_raw_fd()) {
+        let started = Instant::now();
+        let spawned = spawn_companion(&module.name, module.lib_fd.as_raw_fd());
+        stats::record_companion_spawn(&module.name, started.elapsed());
+        match spawned {
             Ok(Some(sock)) => {
                 trace!("Spawned new companion for `{}`.", module.name);
                 *companion = Some(sock);